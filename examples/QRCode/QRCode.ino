@@ -47,51 +47,129 @@
 #define DEFAULT_QR_VERSION 3
 #define DEFAULT_QR_STRING  "HELLO WORLD"
 
+#define QR_USAGE \
+  "Usage: qr [-v 1..40|auto] [-e L|M|Q|H] [-m auto|mixed] [-q quiet]\n" \
+  "          [-c utf8|cp437] [-i] [text]\n"
+
 
 extern "C" {
 
+  // Decimal number up to "max", -1 if not one
+  static int parseNumber(const char *str, int max) {
+    int value = 0;
+
+    if (!*str) return -1;
+    for (; *str; str++) {
+      if ((*str < '0') || (*str > '9')) return -1;
+      value = value * 10 + (*str - '0');
+      if (value > max) return -1;
+    }
+    return value;
+  }
+
   int qrcode(rt_uint8_t argc, char **argv) {
-    int ret;
-    rt_uint32_t qrver;
+    int ret, value;
+    rt_uint8_t qrver, ecc, i;
     const char *qrstr;
     rt_uint8_t *qrcodeBytes;
+    char *line;
     QRCode qrc;
-    rt_uint8_t x, y;
-
-    if (argc > 1) qrstr = argv[1];
-    else
-      qrstr = DEFAULT_QR_STRING;
-
-    if (argc > 2) qrver = (rt_uint32_t)argv[2];
-    else
-      qrver = DEFAULT_QR_VERSION;
-
+    QRCodeOptions options;
+    QRTermOptions term;
+    rt_uint16_t y;
+
+    qrver = DEFAULT_QR_VERSION;
+    ecc = ECC_LOW;
+    qrstr = DEFAULT_QR_STRING;
+    qrcode_initOptions(&options);
+    qrcode_initTermOptions(&term);
+    qrcodeBytes = RT_NULL;
+    line = RT_NULL;
     ret = RT_EOK;
 
+    for (i = 1; (RT_EOK == ret) && (i < argc); i++) {
+      if ('-' != argv[i][0]) {
+        qrstr = argv[i];
+        continue;
+      }
+      if (argv[i][2] || ((i + 1 >= argc) && ('i' != argv[i][1]))) {
+        ret = -RT_EINVAL;
+        break;
+      }
+      switch (argv[i][1]) {
+      case 'v':
+        if (!rt_strcmp(argv[++i], "auto")) {
+          qrver = QR_VERSION_AUTO;
+        } else {
+          value = parseNumber(argv[i], 40);
+          if (value < 1) ret = -RT_EINVAL;
+          else qrver = value;
+        }
+        break;
+      case 'e':
+        switch (argv[++i][0]) {
+        case 'L': ecc = ECC_LOW; break;
+        case 'M': ecc = ECC_MEDIUM; break;
+        case 'Q': ecc = ECC_QUARTILE; break;
+        case 'H': ecc = ECC_HIGH; break;
+        default: ret = -RT_EINVAL; break;
+        }
+        break;
+      case 'm':
+        if (!rt_strcmp(argv[++i], "mixed")) options.mixedMode = RT_TRUE;
+        else if (rt_strcmp(argv[i], "auto")) ret = -RT_EINVAL;
+        break;
+      case 'q':
+        value = parseNumber(argv[++i], 8);
+        if (value < 0) ret = -RT_EINVAL;
+        else term.quietZone = value;
+        break;
+      case 'c':
+        if (!rt_strcmp(argv[++i], "cp437")) term.charset = QR_TERM_CP437;
+        else if (rt_strcmp(argv[i], "utf8")) ret = -RT_EINVAL;
+        break;
+      case 'i':
+        term.invert = RT_TRUE;
+        break;
+      default:
+        ret = -RT_EINVAL;
+        break;
+      }
+    }
+    if (RT_EOK != ret) {
+      rt_kprintf(QR_USAGE);
+      return ret;
+    }
+
     do {
-      qrcodeBytes = (rt_uint8_t *)rt_calloc(1, qrcode_getBufferSize(qrver));
+      // QR_VERSION_AUTO may pick up to version 40
+      qrcodeBytes = (rt_uint8_t *)rt_calloc(1,
+        qrcode_getBufferSize(qrver ? qrver : options.maxVersion));
       if (!qrcodeBytes) {
         ret = -RT_ENOMEM;
         break;
       }
 
-      ret = qrcode_initText(&qrc, qrcodeBytes, qrver, ECC_LOW, qrstr);
+      ret = qrcode_initBytesEx(&qrc, qrcodeBytes, qrver, ecc,
+        (rt_uint8_t *)qrstr, rt_strlen(qrstr), &options);
       if (ret < 0) break;
 
-      rt_kprintf("\n");
-      for (y = 0; y < qrc.size; y++) {
-        for (x = 0; x < qrc.size; x++) {
-          if (qrcode_getModule(&qrc, x, y))
-            rt_kprintf("\xdb\xdb");
-          else
-            rt_kprintf("  ");
-        }
-        rt_kprintf("\n");
+      // One console write per text line of two module rows
+      line = (char *)rt_malloc(qrcode_getTermLineSize(&qrc, &term));
+      if (!line) {
+        ret = -RT_ENOMEM;
+        break;
+      }
+      rt_kprintf("\nversion %d\n", qrc.version);
+      for (y = 0; y < qrcode_getTermLines(&qrc, &term); y++) {
+        qrcode_renderTermLine(&qrc, &term, y, line);
+        rt_kputs(line);
       }
-      rt_kprintf("\n");
+      rt_kputs("\n");
 
     } while (0);
 
+    rt_free(line);
     rt_free(qrcodeBytes);
     if (RT_EOK != ret)
       LOG_E("ERR %d", ret);
@@ -0,0 +1,146 @@
+/***************************************************************************//**
+   @file    bench.c
+   @brief   Host encode benchmark for RTT-QRCode
+   @author  onelife <onelife.real[at]gmail.com>
+ ******************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "qrcode.h"
+
+/* NOTES
+    Usage: bench [-t min_ms] [-v from[-to]] [-m auto|fast|0..7] [-w]
+
+    Every version x ECC level x mode is encoded with a payload that fills the
+    symbol to capacity. Each case runs for at least "min_ms" milliseconds.
+    "-m" selects the mask choice ("QRCodeOptions.mask"), auto by default.
+    "-w" encodes in a static workspace instead of the heap.
+    "peak_heap" is the highest "rt_calloc" watermark reached by one encode and
+    "allocs" the number of allocations it made.
+ */
+
+#define DEFAULT_MIN_MS              50
+#define MAX_PAYLOAD                 7089
+
+static const char ECC_NAME[] = "LMQH";
+static const char *const MODE_NAME[] = { "NUM", "ALNUM", "BYTE" };
+
+static const char ALPHANUMERIC[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 $%*+-./:";
+
+static void fillPayload(rt_uint8_t *buf, rt_uint16_t length, rt_uint8_t mode) {
+    rt_uint32_t seed;
+    rt_uint16_t i;
+
+    for (seed = 0x1234567, i = 0; i < length; i++) {
+        seed = seed * 1103515245 + 12345;
+        if (MODE_NUMERIC == mode)
+            buf[i] = '0' + (seed >> 16) % 10;
+        else if (MODE_ALPHANUMERIC == mode)
+            buf[i] = ALPHANUMERIC[(seed >> 16) % (sizeof(ALPHANUMERIC) - 1)];
+        else
+            buf[i] = 0x20 + (seed >> 16) % 0x5f;
+    }
+    // Make sure the encoder can not pick a tighter mode
+    if (MODE_ALPHANUMERIC == mode) buf[0] = 'A';
+    else if (MODE_BYTE == mode) buf[0] = 'a';
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    static rt_uint8_t payload[MAX_PAYLOAD];
+    static rt_uint8_t modules[4000];
+    static rt_uint8_t workspace[QRCODE_WORKSPACE_SIZE(40)];
+    QRCodeOptions options;
+    QRCode qrc;
+    int opt, minMs, fromVer, toVer;
+    rt_uint8_t version, ecc, mode;
+    rt_uint16_t length;
+    rt_uint32_t iterations, i, cases, allocs;
+    rt_size_t peak;
+    double start, elapsed, perEncode, total;
+
+    minMs = DEFAULT_MIN_MS;
+    fromVer = 1;
+    toVer = 40;
+    qrcode_initOptions(&options);
+    while ((opt = getopt(argc, argv, "t:v:m:w")) != -1) {
+        if ('t' == opt) {
+            minMs = atoi(optarg);
+        } else if ('v' == opt) {
+            if (sscanf(optarg, "%d-%d", &fromVer, &toVer) < 2) toVer = fromVer;
+        } else if ('m' == opt) {
+            if (!strcmp(optarg, "auto")) options.mask = QR_MASK_AUTO;
+            else if (!strcmp(optarg, "fast")) options.mask = QR_MASK_FAST;
+            else options.mask = atoi(optarg);
+        } else if ('w' == opt) {
+            options.workspace = workspace;
+        } else {
+            fprintf(stderr, "Usage: %s [-t min_ms] [-v from[-to]] "
+                "[-m auto|fast|0..7] [-w]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (fromVer < 1 || toVer > 40 || fromVer > toVer) {
+        fprintf(stderr, "Bad version range %d-%d\n", fromVer, toVer);
+        return 1;
+    }
+
+    printf("# RTT-QRCode host benchmark, >= %d ms per case, mask %s\n", minMs,
+        (QR_MASK_AUTO == options.mask) ? "auto" : \
+        (QR_MASK_FAST == options.mask) ? "fast" : "fixed");
+    printf("%3s %3s %-5s %5s %12s %12s %9s %6s\n", "ver", "ecc", "mode", "len",
+        "ns/encode", "encodes/s", "peak_heap", "allocs");
+
+    total = 0;
+    cases = 0;
+    for (version = fromVer; version <= toVer; version++) {
+        for (ecc = ECC_LOW; ecc <= ECC_HIGH; ecc++) {
+            for (mode = MODE_NUMERIC; mode <= MODE_BYTE; mode++) {
+                length = qrcode_getCapacity(version, ecc, mode);
+                fillPayload(payload, length, mode);
+
+                rt_heap_reset();
+                peak = rt_heap_peak();
+                if (qrcode_initBytesEx(&qrc, modules, version, ecc, payload,
+                    length, &options) < 0 || qrc.mode != mode) {
+                    fprintf(stderr, "Encode failed: v%d %c %s\n", version,
+                        ECC_NAME[ecc], MODE_NAME[mode]);
+                    return 1;
+                }
+                peak = rt_heap_peak() - peak;
+                allocs = rt_heap_allocs();
+
+                iterations = 0;
+                start = now_ns();
+                do {
+                    for (i = 0; i < 8; i++) {
+                        qrcode_initBytesEx(&qrc, modules, version, ecc,
+                            payload, length, &options);
+                    }
+                    iterations += i;
+                    elapsed = now_ns() - start;
+                } while (elapsed < minMs * 1e6);
+
+                perEncode = elapsed / iterations;
+                total += perEncode;
+                cases++;
+                printf("%3d %3c %-5s %5d %12.0f %12.1f %9lu %6u\n", version,
+                    ECC_NAME[ecc], MODE_NAME[mode], length, perEncode,
+                    1e9 / perEncode, (unsigned long)peak, allocs);
+            }
+        }
+    }
+
+    printf("# %u cases, mean %.0f ns/encode\n", cases, total / cases);
+    return 0;
+}
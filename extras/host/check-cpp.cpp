@@ -0,0 +1,104 @@
+/***************************************************************************//**
+   @file    check-cpp.cpp
+   @brief   Host checks of the C++ front-end of RTT-QRCode
+   @author  onelife <onelife.real[at]gmail.com>
+ ******************************************************************************/
+#include <stdio.h>
+
+#include "qrcode.hpp"
+
+/* NOTES
+    Build with CHECK_LITERAL_OVERFLOW defined must fail: the literal is one
+    byte too long for the symbol.
+ */
+
+static rt_uint32_t failures;
+static rt_uint32_t cases;
+
+#define CHECK(cond, format, args...) \
+    do { \
+        if (!(cond)) { \
+            failures++; \
+            printf("FAIL %s:%d: " format "\n", __FILE__, __LINE__, ##args); \
+        } \
+    } while (0)
+
+static rt_uint8_t payload[7089];
+static rt_uint8_t reference[3917];
+
+// Every version and ECC level: capacities (as qrcode_getCapacity(), from the
+// same tables), and the symbol of the C API
+template <rt_uint8_t Version, rt_uint8_t Ecc>
+struct CheckSymbol {
+    static void run() {
+        static QRCodeT<Version, Ecc> qr;
+        QRCode qrc;
+        rt_uint16_t length, i;
+        rt_uint8_t mode, x, y;
+        rt_bool_t same;
+
+        for (mode = MODE_NUMERIC; mode <= MODE_BYTE; mode++) {
+            CHECK(qr.capacity(mode) == qrcode_getCapacity(Version, Ecc, mode),
+                "v%d ecc %d mode %d capacity", Version, Ecc, mode);
+        }
+
+        length = qr.capacity(MODE_BYTE);
+        for (i = 0; i < length; i++) {
+            payload[i] = (rt_uint8_t)(i * 7 + Version + Ecc);
+        }
+        qrcode_initBytes(&qrc, reference, Version, Ecc, payload, length);
+        rt_heap_reset();
+        CHECK(qr.encode(payload, length) == 0 && 0 == rt_heap_allocs(),
+            "v%d ecc %d encode", Version, Ecc);
+        same = (qr.qrcode().mask == qrc.mask);
+        for (y = 0; y < qr.SIZE; y++) {
+            for (x = 0; x < qr.SIZE; x++) {
+                same = same && \
+                    (qr.getModule(x, y) == qrcode_getModule(&qrc, x, y));
+            }
+        }
+        CHECK(same, "v%d ecc %d symbol", Version, Ecc);
+        CHECK(qr.encode(payload, length + 1) == -RT_EFULL,
+            "v%d ecc %d overflow", Version, Ecc);
+        cases++;
+
+        CheckSymbol<Version + 1, Ecc>::run();
+    }
+};
+
+template <rt_uint8_t Ecc>
+struct CheckSymbol<41, Ecc> {
+    static void run() {}
+};
+
+// Literals are checked at compile time
+static void checkLiteral(void) {
+    static QRCodeT<1, ECC_HIGH> qr;
+
+    static_assert(QRCodeT<1, ECC_HIGH>::capacity(MODE_BYTE) == 7,
+        "v1-H holds 7 bytes");
+    CHECK(qr.encodeLiteral("HELLO 1") == 0 && \
+        qr.qrcode().mode == MODE_ALPHANUMERIC, "literal");
+    #ifdef CHECK_LITERAL_OVERFLOW
+        qr.encodeLiteral("HELLO 12");
+    #endif
+    qr.options().mask = 5;
+    CHECK(qr.encodeText("hello") == 0 && qr.qrcode().mask == 5, "text");
+    cases++;
+}
+
+int main(void) {
+    CheckSymbol<1, ECC_LOW>::run();
+    CheckSymbol<1, ECC_MEDIUM>::run();
+    CheckSymbol<1, ECC_QUARTILE>::run();
+    CheckSymbol<1, ECC_HIGH>::run();
+    checkLiteral();
+    printf("c++ front-end: %u cases\n", cases);
+
+    if (failures) {
+        printf("%u FAILED\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,300 @@
+/***************************************************************************//**
+   @file    check-service.c
+   @brief   Host checks of the encoder service of RTT-QRCode
+   @author  onelife <onelife.real[at]gmail.com>
+ ******************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <time.h>
+
+#include "qrcode.h"
+
+/* NOTES
+    Built with QR_SERVICE, on the pthreads stand-in of "rtthread.c". A
+    request whose callback waits on "gate" holds the service thread, so the
+    requests queued meanwhile are taken together: their order, coalescing and
+    completions are then known. Last, a submitting thread (the UI) posts
+    version 40 requests every millisecond: how long it is held in
+    qrcode_submit() is printed with the throughput of the service.
+ */
+
+#define LARGE_PAYLOAD               2900    // Version 40-L, byte mode
+#define POOL_SIZE                   12
+#define UI_SUBMITS                  400
+
+static rt_uint32_t failures;
+
+#define CHECK(cond, format, args...) \
+    do { \
+        if (!(cond)) { \
+            failures++; \
+            printf("FAIL %s:%d: " format "\n", __FILE__, __LINE__, ##args); \
+        } \
+    } while (0)
+
+static QRService service;
+static rt_sem_t gate, entered, finished;
+static rt_uint8_t payload[LARGE_PAYLOAD];
+static rt_uint8_t modules[POOL_SIZE][3917];
+static QRRequest pool[POOL_SIZE];
+static QRRequest *completed[64];
+static rt_uint32_t completedCount;
+static double submitted[POOL_SIZE], latencyMax, latencySum;
+static rt_bool_t inFlight[POOL_SIZE];
+
+static double nowUs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Completions, in the service thread
+static void onDone(QRRequest *request) {
+    if (completedCount < sizeof(completed) / sizeof(completed[0]))
+        completed[completedCount] = request;
+    completedCount++;
+    rt_sem_release(finished);
+}
+
+// Waits for "count" calls of onDone()
+static rt_bool_t waitDone(rt_uint32_t count) {
+    while (count--) {
+        if (rt_sem_take(finished, 5000) != RT_EOK) return RT_FALSE;
+    }
+    return RT_TRUE;
+}
+
+static void onGate(QRRequest *request) {
+    onDone(request);
+    rt_sem_release(entered);
+    rt_sem_take(gate, RT_WAITING_FOREVER);
+}
+
+// The request is the caller's again once its flag is cleared
+static void onTimed(QRRequest *request) {
+    double latency = nowUs() - submitted[request - pool];
+
+    if (RT_EOK == request->result) {
+        latencySum += latency;
+        if (latency > latencyMax) latencyMax = latency;
+    }
+    rt_enter_critical();
+    inFlight[request - pool] = RT_FALSE;
+    rt_exit_critical();
+}
+
+static rt_bool_t isInFlight(rt_uint32_t index) {
+    rt_bool_t busy;
+
+    rt_enter_critical();
+    busy = inFlight[index];
+    rt_exit_critical();
+    return busy;
+}
+
+static QRRequest *setRequest(rt_uint8_t index, rt_uint8_t slot,
+    rt_uint8_t priority, rt_uint16_t length) {
+    QRRequest *request = &pool[index];
+
+    qrcode_initRequest(request);
+    request->slot = slot;
+    request->priority = priority;
+    request->version = QR_VERSION_AUTO;
+    request->data = payload;
+    request->length = length;
+    request->modules = modules[index];
+    request->done = onDone;
+    return request;
+}
+
+// Holds the service thread in the callback of a request of slot 0
+static void holdService(rt_uint8_t index) {
+    QRRequest *request = setRequest(index, 0, 0, 20);
+
+    request->done = onGate;
+    CHECK(qrcode_submit(&service, request) == RT_EOK, "hold");
+    rt_sem_take(entered, RT_WAITING_FOREVER);
+}
+
+static void releaseLater(void *parameter) {
+    (void)parameter;
+    rt_thread_mdelay(50);
+    rt_sem_release(gate);
+}
+
+static void checkOrder(void) {
+    static const rt_uint8_t EXPECTED[] = { 0, 1, 3, 2, 5, 4 };
+    static rt_uint8_t reference[3917];
+    static rt_uint8_t workspace[QRCODE_WORKSPACE_SIZE(40)];
+    QRCodeOptions options;
+    QRCode qrc;
+    rt_uint32_t i;
+
+    completedCount = 0;
+    holdService(0);
+    // Slot, priority: 1 is superseded by 2, which keeps its place before 5
+    setRequest(1, 1, 1, 30);
+    setRequest(2, 1, 1, 40);
+    setRequest(3, 2, 0, 50);
+    setRequest(4, 3, 2, 60);
+    setRequest(5, 0, 1, 70);
+    for (i = 1; i <= 5; i++) {
+        CHECK(qrcode_submit(&service, &pool[i]) == RT_EOK, "submit %u", i);
+    }
+    CHECK(qrcode_submit(&service, &pool[3]) == -RT_EBUSY, "resubmit");
+    CHECK(qrcode_submit(&service, setRequest(6, QR_SERVICE_SLOTS, 0, 10)) == \
+        -RT_EINVAL, "slot");
+    rt_sem_release(gate);
+
+    CHECK(waitDone(6), "completions");
+    for (i = 0; i < 6; i++) {
+        CHECK(completed[i] == &pool[EXPECTED[i]], "order %u: request %d", i,
+            (int)(completed[i] - pool));
+    }
+    CHECK(-RT_EINTR == pool[1].result, "superseded");
+    qrcode_initOptions(&options);
+    options.workspace = workspace;
+    for (i = 2; i <= 5; i++) {
+        qrcode_initBytesEx(&qrc, reference, QR_VERSION_AUTO, ECC_LOW, payload,
+            pool[i].length, &options);
+        CHECK((RT_EOK == pool[i].result) && \
+            (qrc.version == pool[i].qrcode.version) && \
+            (qrc.mask == pool[i].qrcode.mask) && !rt_memcmp(reference,
+            pool[i].modules, qrcode_getBufferSize(qrc.version)),
+            "symbol %u", i);
+    }
+}
+
+static void checkQueueFull(void) {
+    rt_uint32_t i, superseded = service.superseded;
+
+    completedCount = 0;
+    holdService(0);
+    for (i = 1; i <= QR_SERVICE_QUEUE; i++) {
+        CHECK(qrcode_submit(&service, setRequest(i, 3, 0, 10 + i)) == RT_EOK,
+            "queue %u", i);
+    }
+    CHECK(qrcode_submit(&service, setRequest(i, 3, 0, 10)) == -RT_EFULL,
+        "queue full");
+    rt_sem_release(gate);
+    CHECK(waitDone(1 + QR_SERVICE_QUEUE), "completions");
+    CHECK((service.superseded - superseded == QR_SERVICE_QUEUE - 1) && \
+        (RT_EOK == pool[QR_SERVICE_QUEUE].result),
+        "coalesced %u", service.superseded - superseded);
+}
+
+static void checkCompletions(void) {
+    QRRequest *request;
+    rt_sem_t sem;
+    rt_event_t event;
+    rt_uint32_t recved = 0;
+
+    sem = rt_sem_create("check", 0, RT_IPC_FLAG_FIFO);
+    event = rt_event_create("check", RT_IPC_FLAG_FIFO);
+    request = setRequest(0, 0, 0, 100);
+    request->done = RT_NULL;
+    request->sem = sem;
+    CHECK((qrcode_submit(&service, request) == RT_EOK) && \
+        (rt_sem_take(sem, 1000) == RT_EOK) && (RT_EOK == request->result),
+        "semaphore");
+    request = setRequest(1, 1, 0, 100);
+    request->done = RT_NULL;
+    request->event = event;
+    request->set = 0x04;
+    CHECK((qrcode_submit(&service, request) == RT_EOK) && \
+        (rt_event_recv(event, 0x04, RT_EVENT_FLAG_OR | RT_EVENT_FLAG_CLEAR,
+        1000, &recved) == RT_EOK) && (0x04 == recved) && \
+        (RT_EOK == request->result), "event");
+    rt_sem_delete(sem);
+    rt_event_delete(event);
+}
+
+// The UI thread submits every millisecond, round robin over the slots
+static void measure(void) {
+    QRRequest *request;
+    rt_uint32_t i, sent = 0, busy = 0, encoded, superseded;
+    double start, elapsed, t, submitMax = 0, submitSum = 0;
+
+    encoded = service.encoded;
+    superseded = service.superseded;
+    for (i = 0; i < POOL_SIZE; i++) qrcode_initRequest(&pool[i]);
+    start = nowUs();
+    for (i = 0; i < UI_SUBMITS; i++) {
+        request = &pool[i % POOL_SIZE];
+        if (isInFlight(i % POOL_SIZE)) {
+            busy++;
+        } else {
+            setRequest(i % POOL_SIZE, i % QR_SERVICE_SLOTS, 0,
+                LARGE_PAYLOAD - i % 7);
+            request->done = onTimed;
+            inFlight[i % POOL_SIZE] = RT_TRUE;
+            t = nowUs();
+            submitted[i % POOL_SIZE] = t;
+            if (qrcode_submit(&service, request) == RT_EOK) sent++;
+            else inFlight[i % POOL_SIZE] = RT_FALSE;
+            t = nowUs() - t;
+            submitSum += t;
+            if (t > submitMax) submitMax = t;
+        }
+        rt_thread_mdelay(1);
+    }
+    for (i = 0; i < POOL_SIZE; i++) {
+        while (isInFlight(i)) rt_thread_mdelay(1);
+    }
+    elapsed = nowUs() - start;
+    encoded = service.encoded - encoded;
+    superseded = service.superseded - superseded;
+
+    CHECK(sent && (encoded + superseded == sent), "sent %u, encoded %u, "
+        "superseded %u", sent, encoded, superseded);
+    printf("submit: %u sent, %u busy, max %.1f us, avg %.2f us\n", sent, busy,
+        submitMax, submitSum / (sent + !sent));
+    printf("service: %u v40 encoded (%.0f/s), %u superseded, latency avg "
+        "%.0f us, max %.0f us\n", encoded, encoded * 1e6 / elapsed, superseded,
+        latencySum / (encoded + !encoded), latencyMax);
+}
+
+static void checkStop(void) {
+    rt_thread_t releaser;
+
+    completedCount = 0;
+    holdService(0);
+    CHECK(qrcode_submit(&service, setRequest(1, 1, 0, 10)) == RT_EOK,
+        "queued");
+    // The stop request goes before it, the gate opens once it is posted
+    releaser = rt_thread_create("release", releaseLater, RT_NULL, 1024, 10,
+        10);
+    rt_thread_startup(releaser);
+    CHECK(qrcode_stopService(&service) == RT_EOK, "stop");
+    CHECK(waitDone(2) && (-RT_EINTR == pool[1].result), "cancel");
+}
+
+int main(void) {
+    rt_uint32_t i;
+
+    for (i = 0; i < sizeof(payload); i++) payload[i] = 'a' + i * 7 % 26;
+    gate = rt_sem_create("gate", 0, RT_IPC_FLAG_FIFO);
+    entered = rt_sem_create("entered", 0, RT_IPC_FLAG_FIFO);
+    finished = rt_sem_create("finished", 0, RT_IPC_FLAG_FIFO);
+    CHECK(qrcode_startService(&service, 0, 10, 4096) == -RT_EINVAL, "version");
+    if (qrcode_startService(&service, 40, 10, 4096) != RT_EOK) {
+        printf("FAIL: start\n");
+        return 1;
+    }
+
+    rt_heap_reset();
+    checkOrder();
+    checkQueueFull();
+    checkCompletions();
+    measure();
+    CHECK(!rt_heap_allocs(), "%u allocations", rt_heap_allocs());
+    checkStop();
+
+    if (failures) {
+        printf("%u FAILED\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
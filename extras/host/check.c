@@ -0,0 +1,1411 @@
+/***************************************************************************//**
+   @file    check.c
+   @brief   Host regression checks for RTT-QRCode
+   @author  onelife <onelife.real[at]gmail.com>
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+/* NOTES
+    The library source is included so its static functions can be compared
+    against the reference implementations kept here.
+ */
+#define QR_EXPORT_FD                1
+#include "qrcode.c"
+
+#define MAX_GRID_BYTES              3917
+#define MAX_PAYLOAD                 7089
+
+static rt_uint32_t failures;
+
+#if QR_LOW_MEMORY
+// The library has no grid to read bit by bit in this mode
+static rt_bool_t bb_getBit(BitBucket *bitGrid, rt_uint8_t x, rt_uint8_t y) {
+    rt_uint32_t offset;
+
+    offset = y * bitGrid->bitOffsetOrWidth + x;
+    return (bitGrid->data[offset >> 3] & (0x80 >> (offset & 0x07))) != 0;
+}
+#endif
+
+#define CHECK(cond, format, args...) \
+    do { \
+        if (!(cond)) { \
+            failures++; \
+            printf("FAIL %s:%d: " format "\n", __FILE__, __LINE__, ##args); \
+        } \
+    } while (0)
+
+static const char ALPHANUMERIC[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 $%*+-./:";
+
+static void fillPayload(rt_uint8_t *buf, rt_uint16_t length, rt_uint8_t mode,
+    rt_uint32_t seed) {
+    rt_uint16_t i;
+
+    for (i = 0; i < length; i++) {
+        seed = seed * 1103515245 + 12345;
+        if (MODE_NUMERIC == mode) buf[i] = '0' + (seed >> 16) % 10;
+        else if (MODE_ALPHANUMERIC == mode) buf[i] = ALPHANUMERIC[(seed >> 16) % 45];
+        else buf[i] = (seed >> 16) & 0xff;
+    }
+    if (MODE_ALPHANUMERIC == mode) buf[0] = 'A';
+    else if (MODE_BYTE == mode) buf[0] = 'a';
+}
+
+/* Digests of the symbols produced by the original implementation. For every
+   version: each ECC level x mode, filled to capacity and to half of it.
+ */
+static const rt_uint32_t GOLDEN_DIGESTS[40] = {
+    0x3535484a, 0xa0588cc0, 0xeb3b552c, 0xae5dd34c, 0xd36ea997,
+    0xbb1b6788, 0xcc60378b, 0x56fc9604, 0xb473c306, 0x5fd4de76,
+    0x0791d0fb, 0x4021fd8b, 0x23f66087, 0x83e9fc86, 0x87418eb5,
+    0x3e8de4ec, 0x20d949c8, 0xc7a55b0b, 0x395311ff, 0xe86f3297,
+    0x3c065661, 0x7d762e82, 0x269b1d3a, 0xfd998d1c, 0x43d3705b,
+    0x75a68e5a, 0x435f3c40, 0x03f82e7e, 0xafd5a2fc, 0x0ff09e3b,
+    0x6c142927, 0x2627375c, 0xe674a963, 0xb71f3f40, 0xe9b496a8,
+    0x0bba86f4, 0xf31d354f, 0x7d8a8a27, 0xdf2694f7, 0xf4e2c2d5,
+};
+
+static rt_uint32_t fnv1a(rt_uint32_t hash, const rt_uint8_t *data,
+    rt_uint32_t length) {
+    while (length--) hash = (hash ^ *data++) * 16777619;
+    return hash;
+}
+
+static void checkGoldenSymbols(void) {
+    static rt_uint8_t payload[MAX_PAYLOAD], modules[MAX_GRID_BYTES];
+    QRCode qrc;
+    rt_uint32_t hash;
+    rt_uint16_t length;
+    rt_uint8_t version, first, last, ecc, mode, half;
+
+    first = 1;
+    last = 40;
+    #if (LOCK_VERSION != 0)
+        first = last = LOCK_VERSION;
+    #endif
+    for (version = first; version <= last; version++) {
+        hash = 2166136261;
+        for (ecc = ECC_LOW; ecc <= ECC_HIGH; ecc++) {
+            for (mode = MODE_NUMERIC; mode <= MODE_BYTE; mode++) {
+                for (half = 0; half < 2; half++) {
+                    length = qrcode_getCapacity(version, ecc, mode);
+                    if (half) length = length / 2 + 1;
+                    fillPayload(payload, length, mode,
+                        version * 131 + ecc * 17 + mode * 5 + half);
+                    CHECK(qrcode_initBytes(&qrc, modules, version, ecc,
+                        payload, length) == 0, "v%d encode", version);
+                    hash = fnv1a(hash, &qrc.mask, 1);
+                    hash = fnv1a(hash, &qrc.mode, 1);
+                    hash = fnv1a(hash, modules, qrcode_getBufferSize(version));
+                }
+            }
+        }
+        CHECK(hash == GOLDEN_DIGESTS[version - 1], "v%d digest %08x", version,
+            hash);
+    }
+    printf("golden symbols: %d versions\n", last - first + 1);
+}
+
+#if (LOCK_VERSION == 0)
+/* The original bit-by-bit penalty score, kept as the reference for the
+   word-parallel getPenaltyScore().
+ */
+static rt_uint32_t refPenaltyScore(BitBucket *modules) {
+    rt_uint32_t result;
+    rt_uint8_t size, x, y, runX, runY;
+    rt_uint16_t black, total, k;
+
+    result = 0;
+    size = modules->bitOffsetOrWidth;
+
+    for (y = 0; y < size; y++) {
+        rt_bool_t colorX, cx;
+        colorX = bb_getBit(modules, 0, y);
+        for (x = 1, runX = 1; x < size; x++) {
+            cx = bb_getBit(modules, x, y);
+            if (cx != colorX) {
+                colorX = cx;
+                runX = 1;
+            } else {
+                runX++;
+                if (runX == 5) result += PENALTY_N1;
+                else if (runX > 5) result++;
+            }
+        }
+    }
+
+    for (x = 0; x < size; x++) {
+        rt_bool_t colorY, cy;
+        colorY = bb_getBit(modules, x, 0);
+        for (y = 1, runY = 1; y < size; y++) {
+            cy = bb_getBit(modules, x, y);
+            if (cy != colorY) {
+                colorY = cy;
+                runY = 1;
+            } else {
+                runY++;
+                if (runY == 5) result += PENALTY_N1;
+                else if (runY > 5) result++;
+            }
+        }
+    }
+
+    black = 0;
+    for (y = 0; y < size; y++) {
+        rt_uint16_t bitsRow = 0;
+        rt_uint16_t bitsCol = 0;
+
+        for (x = 0; x < size; x++) {
+            rt_bool_t color = bb_getBit(modules, x, y);
+
+            if (x > 0 && y > 0) {
+                rt_bool_t colorUL = bb_getBit(modules, x - 1, y - 1);
+                rt_bool_t colorUR = bb_getBit(modules, x, y - 1);
+                rt_bool_t colorL = bb_getBit(modules, x - 1, y);
+                if (color == colorUL && color == colorUR && color == colorL)
+                    result += PENALTY_N2;
+            }
+
+            bitsRow = ((bitsRow << 1) & 0x7FF) | color;
+            bitsCol = ((bitsCol << 1) & 0x7FF) | bb_getBit(modules, y, x);
+            if (x >= 10) {
+                if (bitsRow == 0x05D || bitsRow == 0x5D0) result += PENALTY_N3;
+                if (bitsCol == 0x05D || bitsCol == 0x5D0) result += PENALTY_N3;
+            }
+
+            if (color) black++;
+        }
+    }
+
+    total = size * size;
+    for (k = 0;
+        ((black * 20) < ((9 - k) * total)) || \
+        ((black * 20) > ((11 + k) * total));
+        k++) {
+        result += PENALTY_N4;
+    }
+
+    return result;
+}
+
+// The original per-module applyMask()
+static void refApplyMask(BitBucket *modules, FunctionMap *isFunction,
+    rt_uint8_t mask) {
+    rt_uint8_t x, y, size;
+    rt_bool_t invert;
+
+    size = modules->bitOffsetOrWidth;
+    for (y = 0; y < size; y++) {
+        for (x = 0; x < size; x++) {
+            if ((fm_getWord(isFunction, x & ~0x1f, y) << (x & 0x1f)) & \
+                0x80000000) {
+                continue;
+            }
+
+            if (0 == mask) invert = (x + y) % 2 == 0;
+            else if (1 == mask) invert = y % 2 == 0;
+            else if (2 == mask) invert = x % 3 == 0;
+            else if (3 == mask) invert = (x + y) % 3 == 0;
+            else if (4 == mask) invert = (x / 3 + y / 2) % 2 == 0;
+            else if (5 == mask) invert = x * y % 2 + x * y % 3 == 0;
+            else if (6 == mask) invert = (x * y % 2 + x * y % 3) % 2 == 0;
+            else invert = ((x + y) % 2 + x * y % 3) % 2 == 0;
+            if (invert) bb_setBit(modules, x, y, !bb_getBit(modules, x, y));
+        }
+    }
+}
+
+// The function modules of a version, as the library keeps them
+static void initFunctionMap(FunctionMap *isFunction, rt_uint8_t *grid,
+    rt_uint8_t version) {
+    #if QR_LOW_MEMORY
+        (void)grid;
+        fm_init(isFunction, version);
+    #else
+        bb_initGrid(isFunction, grid, version * 4 + 17);
+    #endif
+}
+
+static rt_uint32_t random32(rt_uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 8) ^ (*seed << 13);
+}
+
+/* Word-parallel penalty against the reference: random grids of every size and
+   density, uniform and striped grids, and every mask of real symbols.
+ */
+static void checkPenaltyScore(void) {
+    static rt_uint8_t grid[MAX_GRID_BYTES], funcs[MAX_GRID_BYTES];
+    static rt_uint8_t scratchBytes[MAX_GRID_BYTES], payload[MAX_PAYLOAD];
+    BitBucket modules, scratch;
+    FunctionMap isFunction;
+    QRCode qrc;
+    rt_uint32_t seed, bits, i, cases, minPenalty;
+    rt_uint8_t version, size, density, ecc, eccFormatBits, mode, mask, best;
+    rt_uint8_t x, y;
+
+    cases = 0;
+    seed = 1;
+    for (version = 1; version <= 40; version++) {
+        size = version * 4 + 17;
+        bb_initGrid(&modules, grid, size);
+
+        // Random grids, from sparse to dense, and with long runs
+        for (density = 0; density <= 8; density++) {
+            for (i = 0; i < modules.capacityBytes; i++) {
+                bits = random32(&seed);
+                if (density < 4) bits &= random32(&seed) | (density << 3);
+                else if (density > 4) bits |= random32(&seed) & (0xff >> density);
+                grid[i] = bits;
+            }
+            if (8 == density) {
+                for (i = 0; i < modules.capacityBytes; i++)
+                    grid[i] = (random32(&seed) & 0x10) ? 0xff : 0x00;
+            }
+            CHECK(getPenaltyScore(&modules, RT_NULL, 0, 0xFFFFFFFF) == refPenaltyScore(&modules),
+                "random grid v%d density %d", version, density);
+            cases++;
+        }
+
+        // Uniform, checkerboard and striped grids
+        for (i = 0; i < 6; i++) {
+            for (y = 0; y < size; y++) {
+                for (x = 0; x < size; x++) {
+                    bb_setBit(&modules, x, y,
+                        (0 == i) ? 0 : (1 == i) ? 1 : (2 == i) ? (x + y) & 1 : \
+                        (3 == i) ? (x / 5) & 1 : (4 == i) ? (y % 11) < 5 : \
+                        ((x * 7 + y * 3) % 13) < 6);
+                }
+            }
+            CHECK(getPenaltyScore(&modules, RT_NULL, 0, 0xFFFFFFFF) == refPenaltyScore(&modules),
+                "pattern %d v%d", i, version);
+            cases++;
+        }
+
+        // Every mask of real symbols
+        for (ecc = ECC_LOW; ecc <= ECC_HIGH; ecc++) {
+            for (mode = MODE_NUMERIC; mode <= MODE_BYTE; mode++) {
+                rt_uint16_t length = \
+                    qrcode_getCapacity(version, ecc, mode) / 2 + 1;
+
+                fillPayload(payload, length, mode, seed++);
+                qrcode_initBytes(&qrc, grid, version, ecc, payload, length);
+                bb_initGrid(&scratch, scratchBytes, size);
+                initFunctionMap(&isFunction, funcs, version);
+                eccFormatBits = (ECC_FORMAT_BITS >> (2 * ecc)) & 0x03;
+                drawFunctionPatterns(&scratch, &isFunction, version,
+                    eccFormatBits);
+                best = 0;
+                minPenalty = 0xFFFFFFFF;
+                for (mask = 0; mask < 8; mask++) {
+                    drawFormatBits(&modules, &isFunction, eccFormatBits, mask);
+                    bits = getPenaltyScore(&modules, &isFunction, mask,
+                        0xFFFFFFFF);
+                    if (bits < minPenalty) {
+                        best = mask;
+                        minPenalty = bits;
+                    }
+                    applyMask(&modules, &isFunction, mask);
+                    CHECK(getPenaltyScore(&modules, RT_NULL, 0, 0xFFFFFFFF) == \
+                        refPenaltyScore(&modules) && \
+                        bits == refPenaltyScore(&modules),
+                        "v%d ecc %d mode %d mask %d", version, ecc, mode, mask);
+                    applyMask(&modules, &isFunction, mask);
+                    cases++;
+                }
+                CHECK(getBestMask(&modules, &isFunction, eccFormatBits, RT_FALSE) == \
+                    best, "v%d ecc %d mode %d best mask", version, ecc, mode);
+            }
+        }
+    }
+    printf("penalty score: %u cases\n", cases);
+}
+
+// Word-wide applyMask() against the reference, on random grids
+static void checkApplyMask(void) {
+    static rt_uint8_t grid[MAX_GRID_BYTES], refGrid[MAX_GRID_BYTES];
+    static rt_uint8_t funcs[MAX_GRID_BYTES];
+    BitBucket modules, reference;
+    FunctionMap isFunction;
+    rt_uint32_t seed, i;
+    rt_uint8_t version, size, mask;
+
+    seed = 7;
+    for (version = 1; version <= 40; version++) {
+        size = version * 4 + 17;
+        bb_initGrid(&modules, grid, size);
+        bb_initGrid(&reference, refGrid, size);
+        initFunctionMap(&isFunction, funcs, version);
+        drawFunctionPatterns(&reference, &isFunction, version, 0);
+        for (mask = 0; mask < 8; mask++) {
+            for (i = 0; i < modules.capacityBytes; i++) {
+                grid[i] = refGrid[i] = random32(&seed);
+            }
+            applyMask(&modules, &isFunction, mask);
+            refApplyMask(&reference, &isFunction, mask);
+            CHECK(!rt_memcmp(grid, refGrid, modules.capacityBytes),
+                "v%d mask %d", version, mask);
+        }
+    }
+    printf("apply mask: 320 cases\n");
+}
+
+/* The function modules the library looks up against those drawn: a module
+   drawn on both a white and a black grid keeps its color only if it is one.
+ */
+static void checkFunctionMap(void) {
+    static rt_uint8_t white[MAX_GRID_BYTES], black[MAX_GRID_BYTES];
+    static rt_uint8_t funcs[MAX_GRID_BYTES];
+    BitBucket whiteGrid, blackGrid;
+    FunctionMap isFunction;
+    rt_uint32_t expected, valid;
+    rt_uint16_t pos;
+    rt_uint8_t version, size, x, y;
+
+    for (version = 1; version <= 40; version++) {
+        size = version * 4 + 17;
+        bb_initGrid(&whiteGrid, white, size);
+        bb_initGrid(&blackGrid, black, size);
+        rt_memset(black, 0xFF, blackGrid.capacityBytes);
+        initFunctionMap(&isFunction, funcs, version);
+        drawFunctionPatterns(&whiteGrid, &isFunction, version, 0);
+        drawFunctionPatterns(&blackGrid, &isFunction, version, 0);
+
+        for (y = 0; y < size; y++) {
+            for (pos = 0; pos < size; pos += 32) {
+                valid = pn_getValidBits(pos, 0, size);
+                expected = ~(bb_getWord(&whiteGrid, y * size + pos) ^ \
+                    bb_getWord(&blackGrid, y * size + pos)) & valid;
+                CHECK((fm_getWord(&isFunction, pos, y) & valid) == expected,
+                    "v%d row %d columns %d", version, y, pos);
+            }
+            for (x = 1; x < size; x++) {
+                CHECK(fm_getPair(&isFunction, x, y) == \
+                    (((bb_getBit(&whiteGrid, x - 1, y) == \
+                    bb_getBit(&blackGrid, x - 1, y)) << 1) | \
+                    (bb_getBit(&whiteGrid, x, y) == bb_getBit(&blackGrid, x, y))),
+                    "v%d modules (%d, %d)", version, x, y);
+            }
+        }
+    }
+    printf("function map: 40 versions\n");
+}
+
+// A fixed mask must reproduce the symbol of the search that picked it
+static void checkMaskOptions(void) {
+    static rt_uint8_t payload[MAX_PAYLOAD], modules[MAX_GRID_BYTES];
+    static rt_uint8_t fixed[MAX_GRID_BYTES];
+    QRCodeOptions options;
+    QRCode qrc;
+    rt_uint16_t length;
+    rt_uint8_t version, ecc, choice;
+
+    for (version = 1; version <= 40; version++) {
+        for (ecc = ECC_LOW; ecc <= ECC_HIGH; ecc++) {
+            length = qrcode_getCapacity(version, ecc, MODE_BYTE) / 2 + 1;
+            fillPayload(payload, length, MODE_BYTE, version * 7 + ecc);
+            for (choice = 0; choice < 2; choice++) {
+                qrcode_initOptions(&options);
+                if (choice) options.mask = QR_MASK_FAST;
+                CHECK(qrcode_initBytesEx(&qrc, modules, version, ecc, payload,
+                    length, &options) == 0, "v%d ecc %d encode", version, ecc);
+                options.mask = qrc.mask;
+                CHECK(qrcode_initBytesEx(&qrc, fixed, version, ecc, payload,
+                    length, &options) == 0 && qrc.mask == options.mask && \
+                    !rt_memcmp(modules, fixed, qrcode_getBufferSize(version)),
+                    "v%d ecc %d fixed mask %d", version, ecc, options.mask);
+            }
+        }
+    }
+    options.mask = 8;
+    CHECK(qrcode_initBytesEx(&qrc, modules, 1, ECC_LOW, payload, 1,
+        &options) == -RT_EINVAL, "mask 8 accepted");
+    printf("mask options: 320 cases\n");
+}
+
+// The workspace must give the heap's symbol, without touching the heap
+static void checkWorkspace(void) {
+    static rt_uint8_t payload[MAX_PAYLOAD], modules[MAX_GRID_BYTES];
+    static rt_uint8_t heapModules[MAX_GRID_BYTES];
+    static rt_uint8_t workspace[QRCODE_WORKSPACE_SIZE(40)];
+    QRCodeOptions options;
+    QRCode qrc;
+    rt_uint16_t length, size, i;
+    rt_uint8_t version, ecc;
+    rt_size_t used;
+    rt_bool_t intact;
+
+    qrcode_initOptions(&options);
+    options.workspace = workspace;
+    used = rt_heap_used();
+    for (version = 1; version <= 40; version++) {
+        CHECK(qrcode_getWorkspaceSize(version) <= \
+            QRCODE_WORKSPACE_SIZE(version), "v%d workspace size", version);
+        // Without mixed mode, the low memory workspace is the codewords only
+        size = qrcode_getWorkspaceSizeEx(version, &options);
+        CHECK(size == (QR_LOW_MEMORY ? \
+            bb_getBufferSizeBytes(NUM_RAW_DATA_MODULES[version - 1]) : \
+            qrcode_getWorkspaceSize(version)), "v%d size %d", version, size);
+        for (ecc = ECC_LOW; ecc <= ECC_HIGH; ecc++) {
+            length = qrcode_getCapacity(version, ecc, MODE_BYTE);
+            fillPayload(payload, length, MODE_BYTE, version * 3 + ecc);
+            qrcode_initBytes(&qrc, heapModules, version, ecc, payload, length);
+            rt_memset(workspace, 0xA5, sizeof(workspace));
+            rt_heap_reset();
+            CHECK(qrcode_initBytesEx(&qrc, modules, version, ecc, payload,
+                length, &options) == 0 && 0 == rt_heap_allocs() && \
+                !rt_memcmp(modules, heapModules, qrcode_getBufferSize(version)),
+                "v%d ecc %d workspace", version, ecc);
+            for (intact = RT_TRUE, i = size; i < sizeof(workspace); i++) {
+                intact = intact && (0xA5 == workspace[i]);
+            }
+            CHECK(intact, "v%d ecc %d past the workspace", version, ecc);
+        }
+    }
+    CHECK(rt_heap_used() == used, "%lu bytes leaked",
+        (unsigned long)(rt_heap_used() - used));
+    printf("workspace: 160 cases\n");
+}
+
+/* Capacity limits: a full symbol encodes, one more character is refused and
+   QR_VERSION_AUTO picks the smallest version that holds the data.
+ */
+static void checkCapacity(void) {
+    static rt_uint8_t payload[MAX_PAYLOAD + 1], modules[MAX_GRID_BYTES];
+    QRCodeOptions options;
+    QRCode qrc;
+    rt_uint16_t length;
+    rt_uint8_t version, ecc, mode, expected;
+
+    qrcode_initOptions(&options);
+    for (version = 1; version <= 40; version++) {
+        for (ecc = ECC_LOW; ecc <= ECC_HIGH; ecc++) {
+            for (mode = MODE_NUMERIC; mode <= MODE_BYTE; mode++) {
+                length = qrcode_getCapacity(version, ecc, mode);
+                fillPayload(payload, length + 1, mode, version + ecc + mode);
+                CHECK(qrcode_initBytes(&qrc, modules, version, ecc, payload,
+                    length) == 0 && qrc.mode == mode,
+                    "v%d ecc %d mode %d full", version, ecc, mode);
+                CHECK(qrcode_initBytes(&qrc, modules, version, ecc, payload,
+                    length + 1) == -RT_EFULL,
+                    "v%d ecc %d mode %d overflow", version, ecc, mode);
+
+                // Lengths just above the capacity of the previous version
+                length = (version > 1) ? \
+                    qrcode_getCapacity(version - 1, ecc, mode) + 1 : 1;
+                for (expected = 1;
+                    qrcode_getCapacity(expected, ecc, mode) < length;
+                    expected++);
+                options.minVersion = 1;
+                options.maxVersion = 40;
+                CHECK(qrcode_initBytesEx(&qrc, modules, QR_VERSION_AUTO, ecc,
+                    payload, length, &options) == 0 && \
+                    qrc.version == expected,
+                    "v%d ecc %d mode %d auto", version, ecc, mode);
+                options.maxVersion = expected - (expected > 1);
+                if (expected > 1) {
+                    CHECK(qrcode_initBytesEx(&qrc, modules, QR_VERSION_AUTO,
+                        ecc, payload, length, &options) == -RT_EFULL,
+                        "v%d ecc %d mode %d range", version, ecc, mode);
+                }
+            }
+        }
+    }
+    CHECK(qrcode_initBytes(&qrc, modules, 41, ECC_LOW, payload, 1) == \
+        -RT_EINVAL, "version 41 accepted");
+    CHECK(qrcode_initBytes(&qrc, modules, 255, ECC_LOW, payload, 1) == \
+        -RT_EINVAL, "version 255 accepted");
+    CHECK(qrcode_initBytes(&qrc, modules, 1, ECC_HIGH + 1, payload, 1) == \
+        -RT_EINVAL, "ecc 4 accepted");
+
+    // Queries out of range
+    CHECK(!qrcode_getCapacity(QR_VERSION_AUTO, ECC_LOW, MODE_BYTE) && \
+        !qrcode_getCapacity(41, ECC_LOW, MODE_BYTE) && \
+        !qrcode_getCapacity(1, ECC_HIGH + 1, MODE_BYTE) && \
+        !qrcode_getCapacity(1, 255, MODE_BYTE) && \
+        !qrcode_getCapacity(1, ECC_LOW, MODE_MIXED) && \
+        !qrcode_getCapacity(1, ECC_LOW, 255), "capacity query");
+    CHECK(!qrcode_getSerializedSize(QR_VERSION_AUTO, ECC_LOW, QR_WIRE_DATA) && \
+        !qrcode_getSerializedSize(41, ECC_LOW, QR_WIRE_PACKED) && \
+        !qrcode_getSerializedSize(1, ECC_HIGH + 1, QR_WIRE_DATA) && \
+        !qrcode_getSerializedSize(1, ECC_LOW, QR_WIRE_DATA + 1),
+        "serialized size query");
+    printf("capacity: 480 cases\n");
+}
+
+static rt_uint32_t bb_readBits(BitBucket *buffer, rt_uint32_t *offset,
+    rt_uint8_t length) {
+    rt_uint32_t result = 0;
+
+    while (length--) {
+        result = (result << 1) | \
+            ((buffer->data[*offset >> 3] >> (7 - (*offset & 7))) & 1);
+        (*offset)++;
+    }
+    return result;
+}
+
+// Decodes the segments of a data bitstream, returns the decoded length
+static rt_uint16_t decodeSegments(BitBucket *buffer, rt_uint8_t version,
+    rt_uint8_t *text) {
+    static const char CHARSET[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+    rt_uint32_t offset, count, value;
+    rt_uint16_t length;
+    rt_uint8_t mode;
+
+    for (offset = 0, length = 0; offset < buffer->bitOffsetOrWidth; ) {
+        value = bb_readBits(buffer, &offset, 4);
+        mode = (1 == value) ? MODE_NUMERIC : (2 == value) ? \
+            MODE_ALPHANUMERIC : MODE_BYTE;
+        count = bb_readBits(buffer, &offset, getModeBits(version, mode));
+        for ( ; count >= 3 && MODE_NUMERIC == mode; count -= 3) {
+            value = bb_readBits(buffer, &offset, 10);
+            text[length++] = '0' + value / 100;
+            text[length++] = '0' + value / 10 % 10;
+            text[length++] = '0' + value % 10;
+        }
+        for ( ; count >= 2 && MODE_ALPHANUMERIC == mode; count -= 2) {
+            value = bb_readBits(buffer, &offset, 11);
+            text[length++] = CHARSET[value / 45];
+            text[length++] = CHARSET[value % 45];
+        }
+        if (MODE_NUMERIC == mode && count) {
+            value = bb_readBits(buffer, &offset, count * 3 + 1);
+            if (2 == count) text[length++] = '0' + value / 10;
+            text[length++] = '0' + value % 10;
+        } else if (MODE_ALPHANUMERIC == mode && count) {
+            text[length++] = CHARSET[bb_readBits(buffer, &offset, 6)];
+        } else if (MODE_BYTE == mode) {
+            while (count--) text[length++] = bb_readBits(buffer, &offset, 8);
+        }
+    }
+    return length;
+}
+
+// The original per-character classification
+static rt_uint8_t refGetMode(const rt_uint8_t *text, rt_uint16_t length) {
+    static const char CHARSET[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+    rt_uint8_t mode;
+    rt_uint16_t i;
+
+    for (i = 0, mode = MODE_NUMERIC; i < length; i++) {
+        if (!text[i] || !strchr(CHARSET, text[i])) return MODE_BYTE;
+        if ((text[i] < '0') || (text[i] > '9')) mode = MODE_ALPHANUMERIC;
+    }
+    return mode;
+}
+
+/* Table and vector classification against the reference: digit runs with one
+   character of every value at every position
+ */
+static void checkClassify(void) {
+    static rt_uint8_t text[600];
+    rt_uint32_t cases;
+    rt_uint16_t length, position, c;
+
+    cases = 0;
+    for (length = 1; length < sizeof(text); length += 1 + length / 8) {
+        for (position = 0; position < length; position += 1 + position / 5) {
+            for (c = 0; c < 256; c++) {
+                rt_memset(text, '7', length);
+                text[position] = c;
+                CHECK(getMode(text, length) == refGetMode(text, length),
+                    "length %d position %d char %02x", length, position, c);
+                cases++;
+            }
+        }
+    }
+    printf("classify: %u cases\n", cases);
+}
+
+/* Mixed mode plans on random texts drawn from digit, alphanumeric and byte
+   runs: they must decode back, take the bits they claim and never more than
+   a single segment.
+ */
+static void checkSegments(void) {
+    static rt_uint8_t text[MAX_PAYLOAD], decoded[MAX_PAYLOAD];
+    static rt_uint8_t planBytes[MAX_PAYLOAD], buffer[MAX_PAYLOAD];
+    static rt_uint8_t modules[MAX_GRID_BYTES];
+    static const char URL[] = "https://x.io/ORDER/000123456789";
+    static rt_uint8_t workspace[QRCODE_WORKSPACE_SIZE(40)];
+    BitBucket codewords;
+    SegPlan plan;
+    QRCodeOptions options;
+    QRCode qrc;
+    rt_uint32_t seed, bits, i, run, cases;
+    rt_uint16_t length;
+    rt_uint8_t version, firstMode, mode, single, kind, expected;
+
+    // Split in two, as the plan of an encode is over both grids
+    plan.regions[0] = planBytes;
+    plan.regions[1] = planBytes + MAX_PAYLOAD / 2;
+    plan.split = seg_getEntries(MAX_PAYLOAD / 2);
+
+    qrcode_initOptions(&options);
+    options.mixedMode = RT_TRUE;
+    options.workspace = workspace;
+    cases = 0;
+    seed = 11;
+    for (version = 1; version <= 40; version += 13) {
+        for (length = 0; length < 5000; length += 1 + length / 4) {
+            for (i = 0; i < length; i += run) {
+                kind = random32(&seed) % 3;
+                run = 1 + random32(&seed) % ((random32(&seed) & 1) ? 3 : 24);
+                for ( ; run && (i + run > length); run--);
+                for (bits = i; bits < i + run; bits++) {
+                    text[bits] = (0 == kind) ? '0' + random32(&seed) % 10 : \
+                        (1 == kind) ? (rt_uint8_t)ALPHANUMERIC[random32(&seed) % 45] : \
+                        (rt_uint8_t)random32(&seed);
+                }
+            }
+            bb_initBuffer(&codewords, buffer, sizeof(buffer));
+            seg_plan(text, length, version, &plan, &firstMode);
+            bits = seg_walk(RT_NULL, text, length, version, &plan, firstMode,
+                &mode);
+            seg_walk(&codewords, text, length, version, &plan, firstMode, &mode);
+            single = getMode(text, length);
+            CHECK(bits == codewords.bitOffsetOrWidth && \
+                bits <= getSegmentBits(version, single, length) && \
+                bits <= seg_plan(text, length, version, RT_NULL, &firstMode) + \
+                    bits / 12 && \
+                decodeSegments(&codewords, version, decoded) == length && \
+                !rt_memcmp(text, decoded, length),
+                "v%d length %d segments", version, length);
+
+            // The smallest version whose exact plan fits
+            for (expected = 1; expected <= 40; expected++) {
+                seg_plan(text, length, expected, &plan, &firstMode);
+                if (seg_walk(RT_NULL, text, length, expected, &plan,
+                    firstMode, &mode) <= getDataCapacityBits(expected, 2))
+                    break;
+            }
+            CHECK(qrcode_initBytesEx(&qrc, modules, QR_VERSION_AUTO, ECC_HIGH,
+                text, length, &options) == ((expected > 40) ? -RT_EFULL : 0) \
+                && ((expected > 40) || (qrc.version == expected)),
+                "length %d auto version %d", length, expected);
+            cases++;
+        }
+    }
+
+    // The example URL fits a smaller symbol
+    options.mixedMode = RT_FALSE;
+    qrcode_initBytesEx(&qrc, modules, QR_VERSION_AUTO, ECC_MEDIUM,
+        (rt_uint8_t *)URL, sizeof(URL) - 1, &options);
+    version = qrc.version;
+    options.mixedMode = RT_TRUE;
+    CHECK(qrcode_initBytesEx(&qrc, modules, QR_VERSION_AUTO, ECC_MEDIUM,
+        (rt_uint8_t *)URL, sizeof(URL) - 1, &options) == 0 && \
+        MODE_MIXED == qrc.mode && qrc.version < version,
+        "URL in v%d, mixed in v%d", version, qrc.version);
+    printf("segments: %u cases\n", cases + 1);
+}
+
+// Pixel (x, y) of a rendered symbol, from qrcode_getModule()
+static rt_bool_t refGetPixel(QRCode *qrc, const QRRenderOptions *options,
+    rt_uint32_t x, rt_uint32_t y) {
+    rt_int32_t moduleX = x / options->scale - options->quietZone;
+    rt_int32_t moduleY = y / options->scale - options->quietZone;
+    rt_bool_t dark;
+
+    dark = (moduleX >= 0) && (moduleY >= 0) && (moduleX < qrc->size) && \
+        (moduleY < qrc->size) && qrcode_getModule(qrc, moduleX, moduleY);
+    return dark != options->invert;
+}
+
+static void checkRender(void) {
+    static const rt_uint8_t VERSIONS[] = { 1, 2, 7, 40 };
+    static const rt_uint8_t SCALES[] = { 1, 2, 3, 4, 5, 8 };
+    static rt_uint8_t modules[3917];
+    static rt_uint8_t line[(177 + 2 * 4) * 8 * 2];
+    static rt_uint8_t expected[sizeof(line)];
+    static rt_uint8_t payload[64];
+    QRCode qrc;
+    QRRenderOptions options;
+    rt_uint32_t cases = 0, rowBytes, x, y, i;
+    rt_uint16_t pixels, length;
+    rt_uint8_t v, s, quiet, format, invert, r, dark;
+    rt_bool_t same;
+
+    fillPayload(payload, sizeof(payload), MODE_BYTE, 19);
+    for (v = 0; v < sizeof(VERSIONS); v++) {
+        // v1-L holds only 17 bytes
+        length = qrcode_getCapacity(VERSIONS[v], ECC_LOW, MODE_BYTE);
+        if (length > sizeof(payload)) length = sizeof(payload);
+        CHECK(qrcode_initBytes(&qrc, modules, VERSIONS[v], ECC_LOW, payload,
+            length) == 0, "v%d encode", VERSIONS[v]);
+        for (s = 0; s < sizeof(SCALES); s++) {
+            // Odd quiet zones put the modules off the byte boundaries
+            for (quiet = 0; quiet <= 4; quiet++) {
+                for (format = QR_RENDER_1BPP_MSB; format <= QR_RENDER_RGB565;
+                    format++) {
+                    for (invert = 0; invert < 2; invert++) {
+                        qrcode_initRenderOptions(&options);
+                        options.format = format;
+                        options.scale = SCALES[s];
+                        options.quietZone = quiet;
+                        options.invert = invert;
+                        pixels = qrcode_getRenderSize(&qrc, &options);
+                        rowBytes = qrcode_getRowBytes(&qrc, &options);
+                        same = (pixels == (qrc.size + 2 * quiet) * SCALES[s]);
+
+                        for (y = 0; same && (y < pixels); y++) {
+                            if ((QR_RENDER_PAGE == format) && (y & 0x07))
+                                continue;
+                            rt_memset(expected, 0x00, rowBytes);
+                            for (x = 0; x < pixels; x++) {
+                                dark = refGetPixel(&qrc, &options, x, y);
+                                switch (format) {
+                                case QR_RENDER_1BPP_MSB:
+                                    expected[x / 8] |= dark << (7 - x % 8);
+                                    break;
+                                case QR_RENDER_1BPP_LSB:
+                                    expected[x / 8] |= dark << (x % 8);
+                                    break;
+                                case QR_RENDER_PAGE:
+                                    for (r = 0; r < 8; r++) {
+                                        dark = (y + r < pixels) ? \
+                                            refGetPixel(&qrc, &options, x,
+                                                y + r) : options.invert;
+                                        expected[x] |= dark << r;
+                                    }
+                                    break;
+                                case QR_RENDER_GRAY8:
+                                    expected[x] = dark ? 0x00 : 0xFF;
+                                    break;
+                                default:
+                                    expected[2 * x] = dark ? 0x00 : 0xFF;
+                                    expected[2 * x + 1] = expected[2 * x];
+                                    break;
+                                }
+                            }
+                            // Padding bits are light
+                            if (options.invert && (format <= \
+                                QR_RENDER_1BPP_LSB) && (pixels % 8)) {
+                                for (x = pixels; x < rowBytes * 8; x++) {
+                                    expected[x / 8] |= \
+                                        (QR_RENDER_1BPP_MSB == format) ? \
+                                        1 << (7 - x % 8) : 1 << (x % 8);
+                                }
+                            }
+                            rt_memset(line, 0x5A, sizeof(line));
+                            same = (qrcode_renderRow(&qrc, &options, y, line) \
+                                == RT_EOK) && \
+                                !rt_memcmp(line, expected, rowBytes);
+                            for (i = rowBytes; same && (i < sizeof(line)); i++)
+                                same = (0x5A == line[i]);
+                        }
+                        CHECK(same, "v%d scale %d quiet %d format %d invert %d"
+                            " row %u", VERSIONS[v], SCALES[s], quiet, format,
+                            invert, y - 1);
+                        cases++;
+                    }
+                }
+            }
+        }
+    }
+
+    // Rejected rows and options
+    qrcode_initRenderOptions(&options);
+    CHECK(qrcode_renderRow(&qrc, &options, pixels, line) == -RT_EINVAL,
+        "row past the end");
+    options.format = QR_RENDER_PAGE;
+    CHECK(qrcode_renderRow(&qrc, &options, 3, line) == -RT_EINVAL,
+        "page row");
+    options.scale = 0;
+    CHECK(qrcode_renderRow(&qrc, &options, 0, line) == -RT_EINVAL, "scale 0");
+    options.scale = 255;
+    options.quietZone = 255;
+    CHECK(!qrcode_getRenderSize(&qrc, &options) && \
+        qrcode_renderRow(&qrc, &options, 0, line) == -RT_EINVAL, "too wide");
+    printf("render: %u cases\n", cases + 1);
+}
+
+// Text lines decoded back into modules
+static void checkTermLines(void) {
+    static const char *const GLYPHS[2][4] = {
+        { " ", "\xe2\x96\x84", "\xe2\x96\x80", "\xe2\x96\x88" },
+        { " ", "\xdc", "\xdf", "\xdb" },
+    };
+    static rt_uint8_t modules[3917];
+    static char buffer[(177 + 2 * 5) * 3 + 2];
+    static rt_uint8_t payload[32];
+    QRCode qrc;
+    QRTermOptions options;
+    rt_uint32_t cases = 0;
+    rt_int16_t length, x, y, side;
+    rt_uint16_t line;
+    rt_uint8_t version, quiet, charset, invert, index, glyph;
+    rt_bool_t same, dark;
+    const char *next;
+
+    fillPayload(payload, sizeof(payload), MODE_BYTE, 23);
+    for (version = 1; version <= 40; version += 13) {
+        // v1-L holds only 17 bytes
+        CHECK(qrcode_initBytes(&qrc, modules, version, ECC_LOW, payload,
+            (1 == version) ? 17 : sizeof(payload)) == 0, "v%d encode",
+            version);
+        for (quiet = 0; quiet <= 5; quiet += 5) {
+            for (charset = QR_TERM_UTF8; charset <= QR_TERM_CP437; charset++) {
+                for (invert = 0; invert < 2; invert++) {
+                    qrcode_initTermOptions(&options);
+                    options.charset = charset;
+                    options.quietZone = quiet;
+                    options.invert = invert;
+                    side = qrc.size + 2 * quiet;
+                    same = (qrcode_getTermLines(&qrc, &options) == \
+                        (side + 1) / 2);
+
+                    for (line = 0; same && (line < (side + 1) / 2); line++) {
+                        length = qrcode_renderTermLine(&qrc, &options, line,
+                            buffer);
+                        same = (length > 0) && \
+                            (length < qrcode_getTermLineSize(&qrc, &options)) \
+                            && ('\n' == buffer[length - 1]) && \
+                            !buffer[length];
+                        for (next = buffer, x = 0; same && (x < side); x++) {
+                            for (glyph = 0; glyph < 4; glyph++) {
+                                if (!strncmp(next, GLYPHS[charset][glyph],
+                                    strlen(GLYPHS[charset][glyph])))
+                                    break;
+                            }
+                            same = (glyph < 4);
+                            next += same ? strlen(GLYPHS[charset][glyph]) : 0;
+                            for (index = 0; index < 2; index++) {
+                                y = 2 * line + index;
+                                dark = (y < side) && \
+                                    (qrcode_getModule(&qrc, x - quiet,
+                                        y - quiet) != invert);
+                                if ((x < quiet) || (x >= quiet + qrc.size) || \
+                                    (y < quiet) || (y >= quiet + qrc.size))
+                                    dark = (y < side) && invert;
+                                same = same && \
+                                    (((glyph >> (1 - index)) & 1) == dark);
+                            }
+                        }
+                        same = same && (next == buffer + length - 1);
+                    }
+                    CHECK(same, "v%d quiet %d charset %d invert %d line %d",
+                        version, quiet, charset, invert, line - 1);
+                    cases++;
+                }
+            }
+        }
+    }
+    qrcode_initTermOptions(&options);
+    CHECK(qrcode_renderTermLine(&qrc, &options,
+        qrcode_getTermLines(&qrc, &options), buffer) == -RT_EINVAL,
+        "line past the end");
+    printf("terminal: %u cases\n", cases + 1);
+}
+
+// Patched symbols against symbols encoded from scratch
+static void checkPatch(void) {
+    static const rt_uint8_t VERSIONS[] = { 1, 2, 5, 7, 10, 21, 27, 40 };
+    static rt_uint8_t payload[MAX_PAYLOAD], patch[64];
+    static rt_uint8_t modules[MAX_GRID_BYTES], expected[MAX_GRID_BYTES];
+    static rt_uint8_t workspace[QRCODE_WORKSPACE_SIZE(40)];
+    QRSymbol symbol;
+    QRCode qrc;
+    QRCodeOptions options;
+    rt_uint32_t cases = 0, seed = 11;
+    rt_uint16_t length, offset, count, i;
+    rt_uint8_t v, ecc, mode, round, keepMask;
+
+    for (v = 0; v < sizeof(VERSIONS); v++) {
+        for (ecc = ECC_LOW; ecc <= ECC_HIGH; ecc++) {
+            for (mode = MODE_NUMERIC; mode <= MODE_BYTE; mode++) {
+                // Not full, so that the last group may be short
+                length = qrcode_getCapacity(VERSIONS[v], ecc, mode) - \
+                    (ecc + v) % 3;
+                fillPayload(payload, length, mode, seed);
+                qrcode_initOptions(&options);
+                CHECK(qrcode_initSymbol(&symbol, modules, workspace,
+                    VERSIONS[v], ecc, payload, length, RT_NULL) == RT_EOK,
+                    "v%d ecc %d mode %d init", VERSIONS[v], ecc, mode);
+
+                for (round = 0; round < 6; round++) {
+                    // The first character keeps the mode
+                    count = 1 + random32(&seed) % ((round < 3) ? 4 : 40);
+                    if (count > length - 1) count = length - 1;
+                    offset = 1 + random32(&seed) % (length - count);
+                    if (2 == round) offset = length - count;
+                    fillPayload(patch, count, mode, random32(&seed));
+                    if (MODE_BYTE == mode) patch[0] = random32(&seed);
+                    else if (MODE_ALPHANUMERIC == mode) patch[0] = '+';
+                    keepMask = (round & 1);
+                    CHECK(qrcode_patchSymbol(&symbol, offset, patch, count,
+                        keepMask) == RT_EOK, "v%d ecc %d mode %d patch",
+                        VERSIONS[v], ecc, mode);
+                    rt_memcpy(&payload[offset], patch, count);
+
+                    options.mask = keepMask ? symbol.qrcode.mask : QR_MASK_AUTO;
+                    qrcode_initBytesEx(&qrc, expected, VERSIONS[v], ecc,
+                        payload, length, &options);
+                    CHECK(qrc.mask == symbol.qrcode.mask && !rt_memcmp(modules,
+                        expected, qrcode_getBufferSize(VERSIONS[v])),
+                        "v%d ecc %d mode %d round %d: %d at %d", VERSIONS[v],
+                        ecc, mode, round, count, offset);
+                    cases++;
+                }
+
+                // Characters out of the mode, and past the data
+                patch[0] = 'a';
+                CHECK((MODE_BYTE == mode) || (qrcode_patchSymbol(&symbol, 1,
+                    patch, 1, RT_TRUE) == -RT_EINVAL), "mode %d char", mode);
+                CHECK(qrcode_patchSymbol(&symbol, length, patch, 1,
+                    RT_TRUE) == -RT_EINVAL, "past the data");
+            }
+        }
+    }
+
+    // Symbols in mixed mode
+    qrcode_initOptions(&options);
+    options.mixedMode = RT_TRUE;
+    for (i = 0; i < 20; i++) payload[i] = (i < 10) ? 'A' : '0';
+    qrcode_initSymbol(&symbol, modules, workspace, 2, ECC_LOW, payload, 20,
+        &options);
+    CHECK(qrcode_patchSymbol(&symbol, 0, payload, 1, RT_TRUE) == -RT_EINVAL,
+        "mixed mode");
+    printf("patch: %u cases\n", cases + 1);
+}
+
+// Regions cover the changed modules exactly, once
+static void checkDirtyRects(void) {
+    static const rt_uint8_t VERSIONS[] = { 1, 3, 14, 40 };
+    static rt_uint8_t payload[128];
+    static rt_uint8_t modules[MAX_GRID_BYTES], other[MAX_GRID_BYTES];
+    static rt_uint8_t covered[177][177];
+    static QRRect rects[2000];
+    QRCode before, after;
+    QRRenderOptions options;
+    rt_uint32_t cases = 0, seed = 5;
+    rt_int32_t count, i;
+    rt_uint16_t px, py, side, length;
+    rt_uint8_t v, round, x, y, changed;
+    rt_bool_t same;
+
+    for (v = 0; v < sizeof(VERSIONS); v++) {
+        length = qrcode_getCapacity(VERSIONS[v], ECC_LOW, MODE_BYTE);
+        if (length > sizeof(payload)) length = sizeof(payload);
+        fillPayload(payload, length, MODE_BYTE, 17);
+        qrcode_initBytes(&before, modules, VERSIONS[v], ECC_LOW, payload,
+            length);
+        for (round = 0; round < 8; round++) {
+            // From a few characters to a different payload and mask
+            for (i = 0; i < 1 + round * round * 2; i++)
+                payload[random32(&seed) % length] ^= 0x01;
+            qrcode_initBytes(&after, other, VERSIONS[v], ECC_LOW, payload,
+                length);
+            qrcode_initRenderOptions(&options);
+            options.scale = 1 + round % 3;
+            options.quietZone = round % 2 ? 4 : 0;
+            side = qrcode_getRenderSize(&before, &options);
+
+            count = qrcode_getDirtyRects(&before, &after, &options, rects,
+                sizeof(rects) / sizeof(rects[0]));
+            rt_memset(covered, 0x00, sizeof(covered));
+            same = (count >= 0);
+            for (i = 0; same && (i < count); i++) {
+                same = (rects[i].width > 0) && (rects[i].height > 0) && \
+                    !(rects[i].x % options.scale) && \
+                    !(rects[i].y % options.scale) && \
+                    !(rects[i].width % options.scale) && \
+                    !(rects[i].height % options.scale) && \
+                    (rects[i].x + rects[i].width <= side) && \
+                    (rects[i].y + rects[i].height <= side);
+                for (py = rects[i].y; same && (py < rects[i].y + \
+                    rects[i].height); py += options.scale) {
+                    for (px = rects[i].x; px < rects[i].x + rects[i].width;
+                        px += options.scale) {
+                        covered[py / options.scale - options.quietZone] \
+                            [px / options.scale - options.quietZone]++;
+                    }
+                }
+            }
+            for (y = 0; same && (y < before.size); y++) {
+                for (x = 0; x < before.size; x++) {
+                    changed = qrcode_getModule(&before, x, y) != \
+                        qrcode_getModule(&after, x, y);
+                    same = same && (covered[y][x] == changed);
+                }
+            }
+            CHECK(same, "v%d round %d: %d regions", VERSIONS[v], round, count);
+
+            // Too few regions still cover everything
+            if (count > 1) {
+                CHECK(qrcode_getDirtyRects(&before, &after, &options, rects,
+                    1) == 1, "v%d round %d one region", VERSIONS[v], round);
+                for (y = 0; y < before.size; y++) {
+                    for (x = 0; x < before.size; x++) {
+                        px = (options.quietZone + x) * options.scale;
+                        py = (options.quietZone + y) * options.scale;
+                        same = same && ((qrcode_getModule(&before, x, y) == \
+                            qrcode_getModule(&after, x, y)) || \
+                            ((px >= rects[0].x) && (py >= rects[0].y) && \
+                             (px < rects[0].x + rects[0].width) && \
+                             (py < rects[0].y + rects[0].height)));
+                    }
+                }
+                CHECK(same, "v%d round %d cover", VERSIONS[v], round);
+            }
+            cases++;
+        }
+        CHECK(qrcode_getDirtyRects(&before, &before, &options, rects, 1) == 0,
+            "v%d no change", VERSIONS[v]);
+    }
+    CHECK(qrcode_getDirtyRects(&before, &after, &options, rects, 0) == \
+        -RT_EINVAL, "no room");
+    printf("dirty regions: %u cases\n", cases + 1);
+}
+
+// Symbols sent in each format come back the same, without heap
+static void checkWire(void) {
+    static rt_uint8_t payload[MAX_PAYLOAD];
+    static rt_uint8_t modules[MAX_GRID_BYTES], received[MAX_GRID_BYTES];
+    static rt_uint8_t workspace[QRCODE_WORKSPACE_SIZE(40)];
+    static rt_uint8_t wire[QR_WIRE_HEADER_SIZE + MAX_GRID_BYTES];
+    QRCodeOptions options;
+    QRCode qrc, out;
+    rt_uint32_t cases = 0;
+    rt_int32_t length;
+    rt_uint16_t count;
+    rt_uint8_t version, ecc, format, mixed;
+
+    for (version = 1; version <= 40; version += 3) {
+        for (ecc = ECC_LOW; ecc <= ECC_HIGH; ecc++) {
+            count = qrcode_getCapacity(version, ecc, MODE_ALPHANUMERIC) / 2;
+            fillPayload(payload, count, MODE_ALPHANUMERIC, version + ecc);
+            qrcode_initBytes(&qrc, modules, version, ecc, payload, count);
+
+            for (format = QR_WIRE_PACKED; format <= QR_WIRE_DATA; format++) {
+                length = qrcode_serialize(&qrc, format, workspace, wire,
+                    sizeof(wire));
+                rt_memset(received, 0x5a, sizeof(received));
+                rt_heap_reset();
+                CHECK((length > QR_WIRE_HEADER_SIZE) && \
+                    ((QR_WIRE_DATA == format) ? (length <= \
+                    qrcode_getSerializedSize(version, ecc, format)) : \
+                    (length == qrcode_getSerializedSize(version, ecc,
+                    format))) && (qrcode_deserialize(&out, received,
+                    (QR_WIRE_PACKED == format) ? RT_NULL : workspace, wire,
+                    length) == RT_EOK) && !rt_heap_allocs() && \
+                    (out.version == version) && (out.ecc == ecc) && \
+                    (out.mask == qrc.mask) && (out.mode == qrc.mode) && \
+                    !rt_memcmp(received, modules,
+                        qrcode_getBufferSize(version)),
+                    "v%d ecc %d format %d", version, ecc, format);
+                CHECK((QR_WIRE_PACKED == format) || (length - \
+                    QR_WIRE_HEADER_SIZE < qrcode_getBufferSize(version)),
+                    "v%d ecc %d format %d size %d", version, ecc, format,
+                    length);
+                cases++;
+            }
+        }
+    }
+
+    // A short payload sends its segments only: 4 + 16 + 80 bits at v10-L
+    qrcode_initOptions(&options);
+    options.workspace = workspace;
+    for (mixed = 0; mixed < 2; mixed++) {
+        options.mixedMode = mixed;
+        if (mixed) {
+            count = 27;
+            rt_memcpy(payload, "HTTP://A.B/0123456789012345", count);
+        } else {
+            count = 10;
+            fillPayload(payload, count, MODE_BYTE, 10);
+        }
+        CHECK(qrcode_initBytesEx(&qrc, modules, 10, ECC_LOW, payload, count,
+            &options) == RT_EOK, "short payload, mixed %d", mixed);
+        length = qrcode_serialize(&qrc, QR_WIRE_DATA, workspace, wire,
+            sizeof(wire));
+        rt_memset(received, 0x5a, sizeof(received));
+        CHECK((mixed || (length == QR_WIRE_HEADER_SIZE + 2 + 13)) && \
+            (MODE_MIXED == qrc.mode) == mixed && \
+            (length < qrcode_getBufferSize(10) / 16) && \
+            (qrcode_deserialize(&out, received, workspace, wire, length) == \
+            RT_EOK) && !rt_memcmp(received, modules, qrcode_getBufferSize(10)),
+            "short payload, mixed %d: %d bytes", mixed, length);
+        cases++;
+    }
+    CHECK(qrcode_deserialize(&out, received, workspace, wire, length - 1) == \
+        -RT_EINVAL, "truncated segments");
+    wire[QR_WIRE_HEADER_SIZE] = 0xff;
+    CHECK(qrcode_deserialize(&out, received, workspace, wire, sizeof(wire)) == \
+        -RT_EINVAL, "bit length");
+
+    // Sent from the heap, received without a workspace when possible
+    CHECK(qrcode_serialize(&qrc, QR_WIRE_CODEWORDS, RT_NULL, wire,
+        sizeof(wire)) > 0, "heap serialize");
+    CHECK(qrcode_deserialize(&out, received, RT_NULL, wire, sizeof(wire)) == \
+        (QR_LOW_MEMORY ? RT_EOK : -RT_EINVAL), "no workspace");
+    CHECK(qrcode_serialize(&qrc, QR_WIRE_DATA, workspace, wire, 10) == \
+        -RT_EFULL, "small buffer");
+    CHECK(qrcode_deserialize(&out, received, workspace, wire, 10) == \
+        -RT_EINVAL, "short message");
+    wire[0] = QR_WIRE_DATA << 6;
+    CHECK(qrcode_deserialize(&out, received, workspace, wire, sizeof(wire)) == \
+        -RT_EINVAL, "version 0");
+    printf("wire: %u cases\n", cases + 1);
+}
+
+// An exported file, taken at most "exportChunk" bytes per call
+static rt_uint8_t exported[600000];
+static rt_uint32_t exportedLength, exportChunk;
+
+static rt_int32_t writeExported(void *context, const void *data,
+    rt_size_t length) {
+    (void)context;
+    if (length > exportChunk) length = exportChunk;
+    if (exportedLength + length > sizeof(exported)) return -1;
+    rt_memcpy(&exported[exportedLength], data, length);
+    exportedLength += length;
+    return length;
+}
+
+static rt_uint32_t refCrc32(const rt_uint8_t *data, rt_uint32_t length) {
+    rt_uint32_t crc = 0xFFFFFFFF;
+    rt_uint8_t i;
+
+    while (length--) {
+        crc ^= *data++;
+        for (i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static rt_uint32_t getU32(const rt_uint8_t *data) {
+    return ((rt_uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | \
+        data[3];
+}
+
+// Compares the pixels of a PBM or PNG file with refGetPixel()
+static rt_bool_t checkPbm(QRCode *qrc, const QRRenderOptions *options,
+    rt_uint16_t pixels) {
+    const rt_uint8_t *row;
+    rt_uint32_t rowBytes = (pixels + 7) / 8, x, y;
+    unsigned width, height;
+    int offset = 0;
+
+    if ((sscanf((const char *)exported, "P4\n%u %u\n%n", &width, &height,
+        &offset) != 2) || (width != pixels) || (height != pixels) || \
+        (exportedLength != offset + rowBytes * pixels)) {
+        return RT_FALSE;
+    }
+    for (y = 0; y < pixels; y++) {
+        row = &exported[offset + y * rowBytes];
+        for (x = 0; x < pixels; x++) {
+            if (((row[x >> 3] >> (7 - (x & 0x07))) & 1) != \
+                refGetPixel(qrc, options, x, y)) {
+                return RT_FALSE;
+            }
+        }
+    }
+    return RT_TRUE;
+}
+
+static rt_bool_t checkPng(QRCode *qrc, const QRRenderOptions *options,
+    rt_uint16_t pixels) {
+    static const rt_uint8_t SIGNATURE[8] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n',
+    };
+    const rt_uint8_t *chunk, *data, *block;
+    rt_uint32_t rowBytes = (pixels + 7) / 8, length, a = 1, b = 0, x, y, i;
+
+    if (rt_memcmp(exported, SIGNATURE, 8)) return RT_FALSE;
+    // IHDR, IDAT, IEND, each with a good CRC
+    for (chunk = &exported[8], i = 0; i < 3; i++) {
+        length = getU32(chunk);
+        if (refCrc32(&chunk[4], 4 + length) != getU32(&chunk[8 + length]) || \
+            rt_memcmp(&chunk[4], (0 == i) ? "IHDR" : (1 == i) ? "IDAT" : \
+            "IEND", 4)) {
+            return RT_FALSE;
+        }
+        if (0 == i) {
+            if ((getU32(&chunk[8]) != pixels) || \
+                (getU32(&chunk[12]) != pixels) || (chunk[16] != 1) || \
+                chunk[17] || chunk[18] || chunk[19] || chunk[20]) {
+                return RT_FALSE;
+            }
+        } else if (1 == i) {
+            data = &chunk[8];
+            if ((data[0] != 0x78) || ((data[0] << 8 | data[1]) % 31) || \
+                (length != 2 + pixels * (6 + rowBytes) + 4)) {
+                return RT_FALSE;
+            }
+            for (y = 0; y < pixels; y++) {
+                block = &data[2 + y * (6 + rowBytes)];
+                if ((block[0] != ((y + 1 == pixels) ? 1 : 0)) || \
+                    ((rt_uint32_t)(block[1] | block[2] << 8) != 1 + rowBytes) \
+                    || ((rt_uint32_t)(block[3] | block[4] << 8) != \
+                        (0xFFFF & ~(1 + rowBytes))) || block[5]) {
+                    return RT_FALSE;
+                }
+                for (x = 0; x < 1 + rowBytes; x++) {
+                    a = (a + block[5 + x]) % 65521;
+                    b = (b + a) % 65521;
+                }
+                for (x = 0; x < pixels; x++) {
+                    // Gray 0 is black
+                    if (((block[6 + (x >> 3)] >> (7 - (x & 0x07))) & 1) == \
+                        refGetPixel(qrc, options, x, y)) {
+                        return RT_FALSE;
+                    }
+                }
+            }
+            if (getU32(&data[length - 4]) != (b << 16 | a)) return RT_FALSE;
+        } else if (length) {
+            return RT_FALSE;
+        }
+        chunk += 12 + length;
+    }
+    return (rt_uint32_t)(chunk - exported) == exportedLength;
+}
+
+// Fills the path of a SVG file back into modules, to compare with the symbol
+static rt_bool_t checkSvg(QRCode *qrc, const QRRenderOptions *options,
+    rt_uint16_t pixels) {
+    static rt_uint8_t drawn[(177 + 2 * 255) * (177 + 2 * 255)];
+    const char *text = (const char *)exported, *path;
+    unsigned width, height, box, x, y, run, back, i;
+    rt_uint32_t side = qrc->size + 2 * options->quietZone;
+    int used;
+
+    exported[exportedLength] = '\0';
+    if ((sscanf(text, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%u\" "
+        "height=\"%u\" viewBox=\"0 0 %u", &width, &height, &box) != 3) || \
+        (width != pixels) || (height != pixels) || (box != side) || \
+        !strstr(text, options->invert ? "<path fill=\"#fff\"" : \
+        "<path fill=\"#000\"") || !(path = strstr(text, " d=\"")) || \
+        rt_strlen(strstr(text, "\"/>\n</svg>\n")) != 11) {
+        return RT_FALSE;
+    }
+    rt_memset(drawn, 0, side * side);
+    for (path += 4; '"' != *path; path += used) {
+        used = 0;
+        if ((sscanf(path, "M%u %uh%uv1h-%uz%n", &x, &y, &run, &back,
+            &used) != 4) || !used || (run != back) || (x + run > side) || \
+            (y >= side)) {
+            return RT_FALSE;
+        }
+        for (i = 0; i < run; i++) drawn[y * side + x + i] = 1;
+        // Runs are merged: the module after one is light
+        if ((x + run < side) && (x + run - options->quietZone < qrc->size) && \
+            qrcode_getModule(qrc, x + run - options->quietZone,
+            y - options->quietZone)) {
+            return RT_FALSE;
+        }
+    }
+    for (y = 0; y < side; y++) {
+        for (x = 0; x < side; x++) {
+            if (drawn[y * side + x] != (refGetPixel(qrc, options,
+                x * options->scale, y * options->scale) != options->invert)) {
+                return RT_FALSE;
+            }
+        }
+    }
+    return RT_TRUE;
+}
+
+static void checkExport(void) {
+    static const rt_uint8_t VERSIONS[] = { 1, 7, 40 };
+    static const rt_uint8_t SCALES[] = { 1, 3, 8 };
+    static rt_uint8_t modules[MAX_GRID_BYTES];
+    static rt_uint8_t buffer[6 + (177 + 2 * 4) * 8];
+    static rt_uint8_t payload[64];
+    QRCode qrc;
+    QRRenderOptions options;
+    FILE *file;
+    rt_uint32_t cases = 0, size;
+    rt_int32_t length;
+    rt_uint16_t pixels;
+    rt_uint8_t v, s, quiet, invert, format;
+    rt_bool_t good;
+
+    qrcode_initRenderOptions(&options);
+    for (v = 0; v < sizeof(VERSIONS); v++) {
+        fillPayload(payload, sizeof(payload), MODE_BYTE, v);
+        qrcode_initBytes(&qrc, modules, VERSIONS[v], ECC_LOW, payload,
+            (VERSIONS[v] > 1) ? sizeof(payload) : 17);
+        for (s = 0; s < sizeof(SCALES); s++) {
+            for (quiet = 0; quiet <= 4; quiet += 4) {
+                for (invert = 0; invert <= 1; invert++) {
+                    options.scale = SCALES[s];
+                    options.quietZone = quiet;
+                    options.invert = invert;
+                    pixels = qrcode_getRenderSize(&qrc, &options);
+                    for (format = QR_EXPORT_PBM; format <= QR_EXPORT_PNG;
+                        format++) {
+                        size = qrcode_getExportBufferSize(&qrc, format,
+                            &options);
+                        exportedLength = 0;
+                        exportChunk = 1000 + cases;
+                        rt_heap_reset();
+                        length = qrcode_export(&qrc, format, &options,
+                            writeExported, RT_NULL, buffer);
+                        good = (size <= sizeof(buffer)) && \
+                            !rt_heap_allocs() && \
+                            (length == (rt_int32_t)exportedLength);
+                        if (QR_EXPORT_PBM == format) {
+                            good = good && checkPbm(&qrc, &options, pixels);
+                        } else if (QR_EXPORT_SVG == format) {
+                            good = good && checkSvg(&qrc, &options, pixels);
+                        } else {
+                            good = good && checkPng(&qrc, &options, pixels);
+                        }
+                        CHECK(good, "v%d scale %d quiet %d invert %d format %d",
+                            VERSIONS[v], SCALES[s], quiet, invert, format);
+                        cases++;
+                    }
+                }
+            }
+        }
+    }
+
+    // The same file from heap to a file descriptor
+    file = tmpfile();
+    CHECK(file && (qrcode_export(&qrc, QR_EXPORT_PNG, &options,
+        qrcode_writeFd, (void *)(rt_base_t)fileno(file), RT_NULL) == \
+        (rt_int32_t)exportedLength) && !fseek(file, 0, SEEK_END) && \
+        (ftell(file) == (long)exportedLength), "file descriptor");
+    if (file) fclose(file);
+    exportChunk = 0;
+    CHECK(qrcode_export(&qrc, QR_EXPORT_SVG, &options, writeExported, RT_NULL,
+        buffer) == -RT_EIO, "write error");
+    CHECK(qrcode_export(&qrc, QR_EXPORT_PNG + 1, &options, writeExported,
+        RT_NULL, buffer) == -RT_EINVAL, "format");
+    printf("export: %u cases\n", cases + 1);
+}
+
+#endif /* (LOCK_VERSION == 0) */
+
+int main(void) {
+#if (LOCK_VERSION == 0)
+    checkPenaltyScore();
+    checkApplyMask();
+    checkFunctionMap();
+    checkGoldenSymbols();
+    checkMaskOptions();
+    checkWorkspace();
+    checkCapacity();
+    checkClassify();
+    checkSegments();
+    checkRender();
+    checkTermLines();
+    checkPatch();
+    checkDirtyRects();
+    checkWire();
+    checkExport();
+#else
+    // Only the locked version can be encoded
+    checkGoldenSymbols();
+#endif
+
+    if (failures) {
+        printf("%u FAILED\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
@@ -0,0 +1,56 @@
+/***************************************************************************//**
+   @file    gentables.c
+   @brief   Generator of the LOCK_VERSION tables of RTT-QRCode
+   @author  onelife <onelife.real[at]gmail.com>
+ ******************************************************************************/
+#include <stdio.h>
+
+/* NOTES
+    The per-version tables of the library are the source: for each version
+    their column is printed as the tables of that LOCK_VERSION, to stdout
+    ("make tables" writes it to "src/qrcode_lock.h").
+ */
+#include "qrcode.c"
+
+int main(void) {
+    rt_uint8_t positions[7];
+    rt_uint8_t version, ecc, count, i;
+
+    printf("/* Generated by extras/host/gentables.c (\"make -C extras/host tables\")"
+        " from\n   the per-version tables of qrcode.c, do not edit.\n\n"
+        "   The tables of a LOCK_VERSION are those of qrcode.c at that version,"
+        " and\n   ALIGNMENT_POSITIONS holds the row (and column) coordinates of"
+        " the alignment\n   pattern centers.\n */\n\n"
+        "#ifndef __QRCODE_LOCK_H__\n#define __QRCODE_LOCK_H__\n");
+
+    for (version = 1; version <= 40; version++) {
+        printf("\n#%s LOCK_VERSION == %d\n", (1 == version) ? "if" : "elif",
+            version);
+        printf("static const rt_uint16_t NUM_ERROR_CORRECTION_CODEWORDS[4] = {\n"
+            "    ");
+        for (ecc = 0; ecc < 4; ecc++) {
+            printf("%d%s", NUM_ERROR_CORRECTION_CODEWORDS[ecc][version - 1],
+                (ecc < 3) ? ", " : "\n};\n");
+        }
+        printf("static const rt_uint8_t NUM_ERROR_CORRECTION_BLOCKS[4] = {\n"
+            "    ");
+        for (ecc = 0; ecc < 4; ecc++) {
+            printf("%d%s", NUM_ERROR_CORRECTION_BLOCKS[ecc][version - 1],
+                (ecc < 3) ? ", " : "\n};\n");
+        }
+        printf("static const rt_uint16_t NUM_RAW_DATA_MODULES = %d;\n",
+            NUM_RAW_DATA_MODULES[version - 1]);
+
+        count = getAlignmentPositions(version, positions);
+        if (!count) continue;
+        printf("static const rt_uint8_t ALIGNMENT_POSITIONS[%d] = {\n    ",
+            count);
+        for (i = 0; i < count; i++) {
+            printf("%d%s", positions[i], (i < count - 1) ? ", " : "\n};\n");
+        }
+    }
+
+    printf("\n#else\n# error Unsupported LOCK_VERSION\n\n#endif\n\n"
+        "#endif  /* __QRCODE_LOCK_H__ */\n");
+    return 0;
+}
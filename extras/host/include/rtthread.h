@@ -0,0 +1,117 @@
+/***************************************************************************//**
+   @file    rtthread.h
+   @brief   Host stand-in for the RT-Thread kernel API used by RTT-QRCode
+   @author  onelife <onelife.real[at]gmail.com>
+ ******************************************************************************/
+#ifndef __RT_THREAD_H__
+#define __RT_THREAD_H__
+
+/* NOTES
+    Only what "qrcode.c" needs is declared here. Keep <stdlib.h> out of this
+    header: the library defines its own static helpers (e.g. "abs").
+    Threads and IPC (for QR_SERVICE) run on pthreads, see "rtthread.c".
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int8_t                      rt_int8_t;
+typedef int16_t                     rt_int16_t;
+typedef int32_t                     rt_int32_t;
+typedef uint8_t                     rt_uint8_t;
+typedef uint16_t                    rt_uint16_t;
+typedef uint32_t                    rt_uint32_t;
+typedef int                         rt_bool_t;
+typedef long                        rt_base_t;
+typedef unsigned long               rt_ubase_t;
+typedef rt_base_t                   rt_err_t;
+typedef rt_ubase_t                  rt_size_t;
+
+#define RT_TRUE                     1
+#define RT_FALSE                    0
+#define RT_NULL                     ((void *)0)
+
+#define RT_EOK                      0
+#define RT_ERROR                    1
+#define RT_ETIMEOUT                 2
+#define RT_EFULL                    3
+#define RT_EEMPTY                   4
+#define RT_ENOMEM                   5
+#define RT_ENOSYS                   6
+#define RT_EBUSY                    7
+#define RT_EIO                      8
+#define RT_EINTR                    9
+#define RT_EINVAL                   10
+
+typedef rt_uint32_t                 rt_tick_t;
+
+#define RT_TICK_PER_SECOND          1000
+#define RT_WAITING_FOREVER          -1
+#define RT_WAITING_NO               0
+
+#define RT_IPC_FLAG_FIFO            0x00
+#define RT_IPC_FLAG_PRIO            0x01
+
+#define RT_EVENT_FLAG_AND           0x01
+#define RT_EVENT_FLAG_OR            0x02
+#define RT_EVENT_FLAG_CLEAR         0x04
+
+typedef struct rt_thread            *rt_thread_t;
+typedef struct rt_messagequeue      *rt_mq_t;
+typedef struct rt_semaphore         *rt_sem_t;
+typedef struct rt_event             *rt_event_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void *rt_malloc(rt_size_t size);
+void *rt_calloc(rt_size_t count, rt_size_t size);
+void rt_free(void *ptr);
+
+void *rt_memset(void *src, int c, rt_ubase_t n);
+void *rt_memcpy(void *dest, const void *src, rt_ubase_t n);
+rt_int32_t rt_memcmp(const void *cs, const void *ct, rt_ubase_t count);
+rt_size_t rt_strlen(const char *src);
+void rt_kprintf(const char *fmt, ...);
+
+void rt_enter_critical(void);
+void rt_exit_critical(void);
+
+rt_tick_t rt_tick_get(void);
+rt_thread_t rt_thread_create(const char *name, void (*entry)(void *parameter),
+    void *parameter, rt_uint32_t stack_size, rt_uint8_t priority,
+    rt_uint32_t tick);
+rt_err_t rt_thread_startup(rt_thread_t thread);
+rt_err_t rt_thread_mdelay(rt_int32_t ms);
+
+rt_mq_t rt_mq_create(const char *name, rt_size_t msg_size, rt_size_t max_msgs,
+    rt_uint8_t flag);
+rt_err_t rt_mq_delete(rt_mq_t mq);
+rt_err_t rt_mq_send(rt_mq_t mq, const void *buffer, rt_size_t size);
+rt_err_t rt_mq_urgent(rt_mq_t mq, const void *buffer, rt_size_t size);
+rt_err_t rt_mq_recv(rt_mq_t mq, void *buffer, rt_size_t size,
+    rt_int32_t timeout);
+
+rt_sem_t rt_sem_create(const char *name, rt_uint32_t value, rt_uint8_t flag);
+rt_err_t rt_sem_delete(rt_sem_t sem);
+rt_err_t rt_sem_take(rt_sem_t sem, rt_int32_t timeout);
+rt_err_t rt_sem_release(rt_sem_t sem);
+
+rt_event_t rt_event_create(const char *name, rt_uint8_t flag);
+rt_err_t rt_event_delete(rt_event_t event);
+rt_err_t rt_event_send(rt_event_t event, rt_uint32_t set);
+rt_err_t rt_event_recv(rt_event_t event, rt_uint32_t set, rt_uint8_t option,
+    rt_int32_t timeout, rt_uint32_t *recved);
+
+/* Host only: heap statistics for the benchmark */
+void rt_heap_reset(void);
+rt_size_t rt_heap_used(void);
+rt_size_t rt_heap_peak(void);
+rt_uint32_t rt_heap_allocs(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RT_THREAD_H__ */
@@ -0,0 +1,428 @@
+/***************************************************************************//**
+   @file    rtthread.c
+   @brief   Host stand-in for the RT-Thread kernel API used by RTT-QRCode
+   @author  onelife <onelife.real[at]gmail.com>
+ ******************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "include/rtthread.h"
+
+/* Every block carries its size in front, so "rt_free" can keep the in-use
+   counter exact. The header is 16 bytes to keep the payload aligned.
+ */
+#define HEAP_HEADER_SIZE            16
+
+static rt_size_t heap_used;
+static rt_size_t heap_peak;
+static rt_uint32_t heap_allocs;
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void *rt_malloc(rt_size_t size) {
+    rt_uint8_t *block;
+
+    block = (rt_uint8_t *)malloc(HEAP_HEADER_SIZE + size);
+    if (!block) return RT_NULL;
+    *(rt_size_t *)block = size;
+
+    pthread_mutex_lock(&heap_lock);
+    heap_used += size;
+    if (heap_used > heap_peak) heap_peak = heap_used;
+    heap_allocs++;
+    pthread_mutex_unlock(&heap_lock);
+
+    return block + HEAP_HEADER_SIZE;
+}
+
+void *rt_calloc(rt_size_t count, rt_size_t size) {
+    void *ptr;
+
+    ptr = rt_malloc(count * size);
+    if (ptr) memset(ptr, 0x00, count * size);
+    return ptr;
+}
+
+void rt_free(void *ptr) {
+    rt_uint8_t *block;
+
+    if (!ptr) return;
+    block = (rt_uint8_t *)ptr - HEAP_HEADER_SIZE;
+    pthread_mutex_lock(&heap_lock);
+    heap_used -= *(rt_size_t *)block;
+    pthread_mutex_unlock(&heap_lock);
+    free(block);
+}
+
+void *rt_memset(void *src, int c, rt_ubase_t n) {
+    return memset(src, c, n);
+}
+
+void *rt_memcpy(void *dest, const void *src, rt_ubase_t n) {
+    return memcpy(dest, src, n);
+}
+
+rt_int32_t rt_memcmp(const void *cs, const void *ct, rt_ubase_t count) {
+    return memcmp(cs, ct, count);
+}
+
+rt_size_t rt_strlen(const char *src) {
+    return strlen(src);
+}
+
+void rt_kprintf(const char *fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+}
+
+/* The scheduler lock is a recursive mutex: it keeps the other threads out of
+   the critical sections only, which is all the library relies on
+ */
+static pthread_mutex_t critical_lock;
+static pthread_once_t critical_once = PTHREAD_ONCE_INIT;
+
+static void critical_init(void) {
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&critical_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void rt_enter_critical(void) {
+    pthread_once(&critical_once, critical_init);
+    pthread_mutex_lock(&critical_lock);
+}
+
+void rt_exit_critical(void) {
+    pthread_mutex_unlock(&critical_lock);
+}
+
+/* Threads and IPC
+
+   Threads are detached pthreads; their stack size and priority are not used,
+   so Linux schedules them as it likes. Each IPC object is a mutex and a
+   condition, and a tick is a millisecond. Kernel objects are not counted in
+   the heap statistics.
+ */
+struct rt_thread {
+    void (*entry)(void *parameter);
+    void *parameter;
+};
+
+typedef struct ipc_object {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} ipc_object;
+
+struct rt_messagequeue {
+    ipc_object ipc;
+    rt_uint8_t *pool;
+    rt_size_t msg_size;
+    rt_size_t max_msgs;
+    rt_size_t head;             // Index of the first message
+    rt_size_t count;
+};
+
+struct rt_semaphore {
+    ipc_object ipc;
+    rt_uint32_t value;
+};
+
+struct rt_event {
+    ipc_object ipc;
+    rt_uint32_t set;
+};
+
+rt_tick_t rt_tick_get(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (rt_tick_t)(ts.tv_sec * RT_TICK_PER_SECOND + \
+        ts.tv_nsec / (1000000000 / RT_TICK_PER_SECOND));
+}
+
+static void *thread_run(void *arg) {
+    struct rt_thread *thread = (struct rt_thread *)arg;
+
+    thread->entry(thread->parameter);
+    free(thread);
+    return NULL;
+}
+
+rt_thread_t rt_thread_create(const char *name, void (*entry)(void *parameter),
+    void *parameter, rt_uint32_t stack_size, rt_uint8_t priority,
+    rt_uint32_t tick) {
+    struct rt_thread *thread;
+
+    (void)name;
+    (void)stack_size;
+    (void)priority;
+    (void)tick;
+    thread = (struct rt_thread *)malloc(sizeof(struct rt_thread));
+    if (!thread) return RT_NULL;
+    thread->entry = entry;
+    thread->parameter = parameter;
+    return thread;
+}
+
+rt_err_t rt_thread_startup(rt_thread_t thread) {
+    pthread_attr_t attr;
+    pthread_t id;
+    int ret;
+
+    // Detached from the start, as "thread" is freed when it returns
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ret = pthread_create(&id, &attr, thread_run, thread);
+    pthread_attr_destroy(&attr);
+    return ret ? -RT_ERROR : RT_EOK;
+}
+
+rt_err_t rt_thread_mdelay(rt_int32_t ms) {
+    struct timespec ts;
+
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) && (EINTR == errno));
+    return RT_EOK;
+}
+
+static void ipc_init(ipc_object *ipc) {
+    pthread_mutex_init(&ipc->lock, NULL);
+    pthread_cond_init(&ipc->changed, NULL);
+}
+
+static void ipc_detach(ipc_object *ipc) {
+    pthread_cond_destroy(&ipc->changed);
+    pthread_mutex_destroy(&ipc->lock);
+}
+
+// The absolute time of "timeout" ticks from now, for ipc_wait()
+static void ipc_deadline(struct timespec *deadline, rt_int32_t timeout) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+    if (timeout < 0) return;
+    deadline->tv_sec += timeout / RT_TICK_PER_SECOND;
+    deadline->tv_nsec += (timeout % RT_TICK_PER_SECOND) * \
+        (1000000000L / RT_TICK_PER_SECOND);
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+// Waits for a change of "ipc" (locked), -RT_ETIMEOUT past the deadline
+static rt_err_t ipc_wait(ipc_object *ipc, rt_int32_t timeout,
+    const struct timespec *deadline) {
+    if (RT_WAITING_NO == timeout) return -RT_ETIMEOUT;
+    if (timeout < 0) {
+        pthread_cond_wait(&ipc->changed, &ipc->lock);
+        return RT_EOK;
+    }
+    if (ETIMEDOUT == pthread_cond_timedwait(&ipc->changed, &ipc->lock,
+        deadline)) {
+        return -RT_ETIMEOUT;
+    }
+    return RT_EOK;
+}
+
+rt_mq_t rt_mq_create(const char *name, rt_size_t msg_size, rt_size_t max_msgs,
+    rt_uint8_t flag) {
+    struct rt_messagequeue *mq;
+
+    (void)name;
+    (void)flag;
+    mq = (struct rt_messagequeue *)malloc(sizeof(struct rt_messagequeue));
+    if (!mq) return RT_NULL;
+    mq->pool = (rt_uint8_t *)malloc(msg_size * max_msgs);
+    if (!mq->pool) {
+        free(mq);
+        return RT_NULL;
+    }
+    ipc_init(&mq->ipc);
+    mq->msg_size = msg_size;
+    mq->max_msgs = max_msgs;
+    mq->head = 0;
+    mq->count = 0;
+    return mq;
+}
+
+rt_err_t rt_mq_delete(rt_mq_t mq) {
+    ipc_detach(&mq->ipc);
+    free(mq->pool);
+    free(mq);
+    return RT_EOK;
+}
+
+// Puts a message last, or first if "urgent"
+static rt_err_t mq_put(rt_mq_t mq, const void *buffer, rt_size_t size,
+    rt_bool_t urgent) {
+    rt_size_t index;
+
+    if (size > mq->msg_size) return -RT_ERROR;
+    pthread_mutex_lock(&mq->ipc.lock);
+    if (mq->count == mq->max_msgs) {
+        pthread_mutex_unlock(&mq->ipc.lock);
+        return -RT_EFULL;
+    }
+    if (urgent) {
+        mq->head = (mq->head + mq->max_msgs - 1) % mq->max_msgs;
+        index = mq->head;
+    } else {
+        index = (mq->head + mq->count) % mq->max_msgs;
+    }
+    memcpy(&mq->pool[index * mq->msg_size], buffer, size);
+    mq->count++;
+    pthread_cond_broadcast(&mq->ipc.changed);
+    pthread_mutex_unlock(&mq->ipc.lock);
+    return RT_EOK;
+}
+
+rt_err_t rt_mq_send(rt_mq_t mq, const void *buffer, rt_size_t size) {
+    return mq_put(mq, buffer, size, RT_FALSE);
+}
+
+rt_err_t rt_mq_urgent(rt_mq_t mq, const void *buffer, rt_size_t size) {
+    return mq_put(mq, buffer, size, RT_TRUE);
+}
+
+rt_err_t rt_mq_recv(rt_mq_t mq, void *buffer, rt_size_t size,
+    rt_int32_t timeout) {
+    struct timespec deadline;
+    rt_err_t ret = RT_EOK;
+
+    ipc_deadline(&deadline, timeout);
+    pthread_mutex_lock(&mq->ipc.lock);
+    while (!mq->count && (RT_EOK == ret)) {
+        ret = ipc_wait(&mq->ipc, timeout, &deadline);
+    }
+    if (mq->count) {
+        memcpy(buffer, &mq->pool[mq->head * mq->msg_size],
+            (size < mq->msg_size) ? size : mq->msg_size);
+        mq->head = (mq->head + 1) % mq->max_msgs;
+        mq->count--;
+        ret = RT_EOK;
+    }
+    pthread_mutex_unlock(&mq->ipc.lock);
+    return ret;
+}
+
+rt_sem_t rt_sem_create(const char *name, rt_uint32_t value, rt_uint8_t flag) {
+    struct rt_semaphore *sem;
+
+    (void)name;
+    (void)flag;
+    sem = (struct rt_semaphore *)malloc(sizeof(struct rt_semaphore));
+    if (!sem) return RT_NULL;
+    ipc_init(&sem->ipc);
+    sem->value = value;
+    return sem;
+}
+
+rt_err_t rt_sem_delete(rt_sem_t sem) {
+    ipc_detach(&sem->ipc);
+    free(sem);
+    return RT_EOK;
+}
+
+rt_err_t rt_sem_take(rt_sem_t sem, rt_int32_t timeout) {
+    struct timespec deadline;
+    rt_err_t ret = RT_EOK;
+
+    ipc_deadline(&deadline, timeout);
+    pthread_mutex_lock(&sem->ipc.lock);
+    while (!sem->value && (RT_EOK == ret)) {
+        ret = ipc_wait(&sem->ipc, timeout, &deadline);
+    }
+    if (sem->value) {
+        sem->value--;
+        ret = RT_EOK;
+    }
+    pthread_mutex_unlock(&sem->ipc.lock);
+    return ret;
+}
+
+rt_err_t rt_sem_release(rt_sem_t sem) {
+    pthread_mutex_lock(&sem->ipc.lock);
+    sem->value++;
+    pthread_cond_broadcast(&sem->ipc.changed);
+    pthread_mutex_unlock(&sem->ipc.lock);
+    return RT_EOK;
+}
+
+rt_event_t rt_event_create(const char *name, rt_uint8_t flag) {
+    struct rt_event *event;
+
+    (void)name;
+    (void)flag;
+    event = (struct rt_event *)malloc(sizeof(struct rt_event));
+    if (!event) return RT_NULL;
+    ipc_init(&event->ipc);
+    event->set = 0;
+    return event;
+}
+
+rt_err_t rt_event_delete(rt_event_t event) {
+    ipc_detach(&event->ipc);
+    free(event);
+    return RT_EOK;
+}
+
+rt_err_t rt_event_send(rt_event_t event, rt_uint32_t set) {
+    pthread_mutex_lock(&event->ipc.lock);
+    event->set |= set;
+    pthread_cond_broadcast(&event->ipc.changed);
+    pthread_mutex_unlock(&event->ipc.lock);
+    return RT_EOK;
+}
+
+static rt_bool_t event_match(rt_event_t event, rt_uint32_t set,
+    rt_uint8_t option) {
+    if (option & RT_EVENT_FLAG_AND) return (event->set & set) == set;
+    return (event->set & set) != 0;
+}
+
+rt_err_t rt_event_recv(rt_event_t event, rt_uint32_t set, rt_uint8_t option,
+    rt_int32_t timeout, rt_uint32_t *recved) {
+    struct timespec deadline;
+    rt_err_t ret = RT_EOK;
+
+    ipc_deadline(&deadline, timeout);
+    pthread_mutex_lock(&event->ipc.lock);
+    while (!event_match(event, set, option) && (RT_EOK == ret)) {
+        ret = ipc_wait(&event->ipc, timeout, &deadline);
+    }
+    if (event_match(event, set, option)) {
+        if (recved) *recved = event->set & set;
+        if (option & RT_EVENT_FLAG_CLEAR) event->set &= ~set;
+        ret = RT_EOK;
+    }
+    pthread_mutex_unlock(&event->ipc.lock);
+    return ret;
+}
+
+void rt_heap_reset(void) {
+    heap_peak = heap_used;
+    heap_allocs = 0;
+}
+
+rt_size_t rt_heap_used(void) {
+    return heap_used;
+}
+
+rt_size_t rt_heap_peak(void) {
+    return heap_peak;
+}
+
+rt_uint32_t rt_heap_allocs(void) {
+    return heap_allocs;
+}
@@ -31,6 +31,14 @@
 
 #include "qrcode.h"
 
+#if QR_EXPORT_FD
+# ifdef RT_USING_DFS
+#  include <dfs_posix.h>
+# else
+#  include <unistd.h>
+# endif
+#endif
+
 typedef struct BitBucket {
     rt_uint32_t bitOffsetOrWidth;
     rt_uint16_t capacityBytes;
@@ -39,12 +47,14 @@ typedef struct BitBucket {
 
 
 #if LOCK_VERSION == 0
+# include "qrcode_tables.h"
+
+// In the order of the ECC format bits
 static const rt_uint16_t NUM_ERROR_CORRECTION_CODEWORDS[4][40] = {
-    // 1,  2,  3,  4,  5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,  16,  17,  18,  19,  20,  21,  22,  23,  24,   25,   26,   27,   28,   29,   30,   31,   32,   33,   34,   35,   36,   37,   38,   39,   40    Error correction level
-    { 10, 16, 26, 36, 48,  64,  72,  88, 110, 130, 150, 176, 198, 216, 240, 280, 308, 338, 364, 416, 442, 476, 504, 560,  588,  644,  700,  728,  784,  812,  868,  924,  980, 1036, 1064, 1120, 1204, 1260, 1316, 1372},  // Medium
-    {  7, 10, 15, 20, 26,  36,  40,  48,  60,  72,  80,  96, 104, 120, 132, 144, 168, 180, 196, 224, 224, 252, 270, 300,  312,  336,  360,  390,  420,  450,  480,  510,  540,  570,  570,  600,  630,  660,  720,  750},  // Low
-    { 17, 28, 44, 64, 88, 112, 130, 156, 192, 224, 264, 308, 352, 384, 432, 480, 532, 588, 650, 700, 750, 816, 900, 960, 1050, 1110, 1200, 1260, 1350, 1440, 1530, 1620, 1710, 1800, 1890, 1980, 2100, 2220, 2310, 2430},  // High
-    { 13, 22, 36, 52, 72,  96, 108, 132, 160, 192, 224, 260, 288, 320, 360, 408, 448, 504, 546, 600, 644, 690, 750, 810,  870,  952, 1020, 1050, 1140, 1200, 1290, 1350, 1440, 1530, 1590, 1680, 1770, 1860, 1950, 2040},  // Quartile
+    QR_ECC_CODEWORDS_MEDIUM,
+    QR_ECC_CODEWORDS_LOW,
+    QR_ECC_CODEWORDS_HIGH,
+    QR_ECC_CODEWORDS_QUARTILE,
 };
 static const rt_uint8_t NUM_ERROR_CORRECTION_BLOCKS[4][40] = {
     // Version: (note that index 0 is for padding, and is set to an illegal value)
@@ -54,29 +64,66 @@ static const rt_uint8_t NUM_ERROR_CORRECTION_BLOCKS[4][40] = {
     {  1, 1, 2, 4, 4, 4, 5, 6, 8, 8, 11, 11, 16, 16, 18, 16, 19, 21, 25, 25, 25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81},  // High
     {  1, 1, 2, 2, 4, 4, 6, 6, 8, 8,  8, 10, 12, 16, 12, 17, 16, 18, 21, 20, 23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68},  // Quartile
 };
-static const rt_uint16_t NUM_RAW_DATA_MODULES[40] = {
-    //    1,     2,     3,     4,     5,     6,     7,     8,     9,   10,     11,    12,    13,    14,    15,    16,    17,    18,   19,     20,   
-        208,   359,   567,   807,  1079,  1383,  1568,  1936,  2336,  2768,  3232,  3728,  4256,  4651,  5243,  5867,  6523,  7211,  7931,  8683, 
-    //   21,    22,    23,    24,    25,   26,    27,     28,    29,    30,    31,    32,    33,    34,    35,    36,    37,    38,    39,    40
-       9252, 10068, 10916, 11796, 12708, 13652, 14628, 15371, 16411, 17483, 18587, 19723, 20891, 22091, 23008, 24272, 25568, 26896, 28256, 29648
-};
+static const rt_uint16_t NUM_RAW_DATA_MODULES[40] = QR_RAW_DATA_MODULES;
+
+#else
+// The column of the tables above at LOCK_VERSION, and its alignment positions
+# include "qrcode_lock.h"
+
+#endif
 
-#elif LOCK_VERSION == 3
-static const rt_int16_t NUM_ERROR_CORRECTION_CODEWORDS[4] = {
-    26, 15, 44, 36
+#if QR_GF_TABLES
+// Antilog (0x02^i) and log tables of GF(2^8/0x11D), note that GF_LOG[0] is unused
+static const rt_uint8_t GF_EXP[255] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1d, 0x3a, 0x74, 0xe8, 0xcd, 0x87, 0x13, 0x26,
+    0x4c, 0x98, 0x2d, 0x5a, 0xb4, 0x75, 0xea, 0xc9, 0x8f, 0x03, 0x06, 0x0c, 0x18, 0x30, 0x60, 0xc0,
+    0x9d, 0x27, 0x4e, 0x9c, 0x25, 0x4a, 0x94, 0x35, 0x6a, 0xd4, 0xb5, 0x77, 0xee, 0xc1, 0x9f, 0x23,
+    0x46, 0x8c, 0x05, 0x0a, 0x14, 0x28, 0x50, 0xa0, 0x5d, 0xba, 0x69, 0xd2, 0xb9, 0x6f, 0xde, 0xa1,
+    0x5f, 0xbe, 0x61, 0xc2, 0x99, 0x2f, 0x5e, 0xbc, 0x65, 0xca, 0x89, 0x0f, 0x1e, 0x3c, 0x78, 0xf0,
+    0xfd, 0xe7, 0xd3, 0xbb, 0x6b, 0xd6, 0xb1, 0x7f, 0xfe, 0xe1, 0xdf, 0xa3, 0x5b, 0xb6, 0x71, 0xe2,
+    0xd9, 0xaf, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0d, 0x1a, 0x34, 0x68, 0xd0, 0xbd, 0x67, 0xce,
+    0x81, 0x1f, 0x3e, 0x7c, 0xf8, 0xed, 0xc7, 0x93, 0x3b, 0x76, 0xec, 0xc5, 0x97, 0x33, 0x66, 0xcc,
+    0x85, 0x17, 0x2e, 0x5c, 0xb8, 0x6d, 0xda, 0xa9, 0x4f, 0x9e, 0x21, 0x42, 0x84, 0x15, 0x2a, 0x54,
+    0xa8, 0x4d, 0x9a, 0x29, 0x52, 0xa4, 0x55, 0xaa, 0x49, 0x92, 0x39, 0x72, 0xe4, 0xd5, 0xb7, 0x73,
+    0xe6, 0xd1, 0xbf, 0x63, 0xc6, 0x91, 0x3f, 0x7e, 0xfc, 0xe5, 0xd7, 0xb3, 0x7b, 0xf6, 0xf1, 0xff,
+    0xe3, 0xdb, 0xab, 0x4b, 0x96, 0x31, 0x62, 0xc4, 0x95, 0x37, 0x6e, 0xdc, 0xa5, 0x57, 0xae, 0x41,
+    0x82, 0x19, 0x32, 0x64, 0xc8, 0x8d, 0x07, 0x0e, 0x1c, 0x38, 0x70, 0xe0, 0xdd, 0xa7, 0x53, 0xa6,
+    0x51, 0xa2, 0x59, 0xb2, 0x79, 0xf2, 0xf9, 0xef, 0xc3, 0x9b, 0x2b, 0x56, 0xac, 0x45, 0x8a, 0x09,
+    0x12, 0x24, 0x48, 0x90, 0x3d, 0x7a, 0xf4, 0xf5, 0xf7, 0xf3, 0xfb, 0xeb, 0xcb, 0x8b, 0x0b, 0x16,
+    0x2c, 0x58, 0xb0, 0x7d, 0xfa, 0xe9, 0xcf, 0x83, 0x1b, 0x36, 0x6c, 0xd8, 0xad, 0x47, 0x8e,
 };
-static const rt_int8_t NUM_ERROR_CORRECTION_BLOCKS[4] = {
-    1, 1, 2, 2
+static const rt_uint8_t GF_LOG[256] = {
+    0x00, 0x00, 0x01, 0x19, 0x02, 0x32, 0x1a, 0xc6, 0x03, 0xdf, 0x33, 0xee, 0x1b, 0x68, 0xc7, 0x4b,
+    0x04, 0x64, 0xe0, 0x0e, 0x34, 0x8d, 0xef, 0x81, 0x1c, 0xc1, 0x69, 0xf8, 0xc8, 0x08, 0x4c, 0x71,
+    0x05, 0x8a, 0x65, 0x2f, 0xe1, 0x24, 0x0f, 0x21, 0x35, 0x93, 0x8e, 0xda, 0xf0, 0x12, 0x82, 0x45,
+    0x1d, 0xb5, 0xc2, 0x7d, 0x6a, 0x27, 0xf9, 0xb9, 0xc9, 0x9a, 0x09, 0x78, 0x4d, 0xe4, 0x72, 0xa6,
+    0x06, 0xbf, 0x8b, 0x62, 0x66, 0xdd, 0x30, 0xfd, 0xe2, 0x98, 0x25, 0xb3, 0x10, 0x91, 0x22, 0x88,
+    0x36, 0xd0, 0x94, 0xce, 0x8f, 0x96, 0xdb, 0xbd, 0xf1, 0xd2, 0x13, 0x5c, 0x83, 0x38, 0x46, 0x40,
+    0x1e, 0x42, 0xb6, 0xa3, 0xc3, 0x48, 0x7e, 0x6e, 0x6b, 0x3a, 0x28, 0x54, 0xfa, 0x85, 0xba, 0x3d,
+    0xca, 0x5e, 0x9b, 0x9f, 0x0a, 0x15, 0x79, 0x2b, 0x4e, 0xd4, 0xe5, 0xac, 0x73, 0xf3, 0xa7, 0x57,
+    0x07, 0x70, 0xc0, 0xf7, 0x8c, 0x80, 0x63, 0x0d, 0x67, 0x4a, 0xde, 0xed, 0x31, 0xc5, 0xfe, 0x18,
+    0xe3, 0xa5, 0x99, 0x77, 0x26, 0xb8, 0xb4, 0x7c, 0x11, 0x44, 0x92, 0xd9, 0x23, 0x20, 0x89, 0x2e,
+    0x37, 0x3f, 0xd1, 0x5b, 0x95, 0xbc, 0xcf, 0xcd, 0x90, 0x87, 0x97, 0xb2, 0xdc, 0xfc, 0xbe, 0x61,
+    0xf2, 0x56, 0xd3, 0xab, 0x14, 0x2a, 0x5d, 0x9e, 0x84, 0x3c, 0x39, 0x53, 0x47, 0x6d, 0x41, 0xa2,
+    0x1f, 0x2d, 0x43, 0xd8, 0xb7, 0x7b, 0xa4, 0x76, 0xc4, 0x17, 0x49, 0xec, 0x7f, 0x0c, 0x6f, 0xf6,
+    0x6c, 0xa1, 0x3b, 0x52, 0x29, 0x9d, 0x55, 0xaa, 0xfb, 0x60, 0x86, 0xb1, 0xbb, 0xcc, 0x3e, 0x5a,
+    0xcb, 0x59, 0x5f, 0xb0, 0x9c, 0xa9, 0xa0, 0x51, 0x0b, 0xf5, 0x16, 0xeb, 0x7a, 0x75, 0x2c, 0xd7,
+    0x4f, 0xae, 0xd5, 0xe9, 0xe6, 0xe7, 0xad, 0xe8, 0x74, 0xd6, 0xf4, 0xea, 0xa8, 0x50, 0x58, 0xaf,
 };
-static const rt_uint16_t NUM_RAW_DATA_MODULES = 567;
-
-#else
-// @TODO: Put other LOCK_VERSIONS here
-# error Unsupported LOCK_VERSION
 
 #endif
 
 
+/* Long payloads are classified 16 characters at a time where the compiler has
+   vectors (SSE2, NEON)
+ */
+#if defined(__GNUC__) && (defined(__SSE2__) || defined(__ARM_NEON))
+# define CLASSIFY_VECTOR            1
+#else
+# define CLASSIFY_VECTOR            0
+#endif
+#define CLASSIFY_VECTOR_MIN         64
+
 static int max(int a, int b) {
     if (a > b) return a;
     return b;
@@ -87,36 +134,29 @@ static int abs(int a) {
     return a;
 }
 
-static rt_int8_t getAlphanumeric(char c) {
-    if (c >= '0' && c <= '9') return (c - '0');
-    if (c >= 'A' && c <= 'Z') return (c - 'A' + 10);
-
-    if (' ' == c) return 36;
-    else if ('$' == c) return 37;
-    else if ('%' == c) return 38;
-    else if ('*' == c) return 39;
-    else if ('+' == c) return 40;
-    else if ('-' == c) return 41;
-    else if ('.' == c) return 42;
-    else if ('/' == c) return 43;
-    else if (':' == c) return 44;
-    else
-        return -1;
-}
-
-static rt_bool_t isAlphanumeric(const char *text, rt_uint16_t length) {
-    while (length != 0)
-        if (getAlphanumeric(text[--length]) == -1) return RT_FALSE;
-    return RT_TRUE;
-}
-
-static rt_bool_t isNumeric(const char *text, rt_uint16_t length) {
-    while (length != 0) {
-        length--;
-        if ((text[length] < '0') || (text[length] > '9')) return RT_FALSE;
-    }
-    return RT_TRUE;
-}
+/* Alphanumeric value of each byte: 0-9 for the digits, up to 44 for the rest
+   of the alphanumeric set and CHAR_BYTE_ONLY for bytes only
+ */
+#define CHAR_BYTE_ONLY              0xff
+
+static const rt_uint8_t CHAR_VALUES[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0x24, 0xff, 0xff, 0xff, 0x25, 0x26, 0xff, 0xff, 0xff, 0xff, 0x27, 0x28, 0xff, 0x29, 0x2a, 0x2b,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x2c, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18,
+    0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
 
 // We store the following tightly packed (less 8) in modeInfo
 //               <=9  <=26  <= 40
@@ -134,11 +174,13 @@ static rt_int8_t getModeBits(rt_uint8_t version, rt_uint8_t mode) {
     rt_int8_t result;
 
     modeInfo = 0x7bbb80a;
-#if (LOCK_VERSION == 0) || (LOCK_VERSION > 9)
+#if (LOCK_VERSION == 0)
     if (version > 9) modeInfo >>= 9;
-#endif
-#if (LOCK_VERSION == 0) || (LOCK_VERSION > 26)
     if (version > 26) modeInfo >>= 9;
+#else
+    (void)version;
+    if (LOCK_VERSION > 9) modeInfo >>= 9;
+    if (LOCK_VERSION > 26) modeInfo >>= 9;
 #endif
 
     result = 8 + ((modeInfo >> (3 * mode)) & 0x07);
@@ -170,16 +212,50 @@ static void bb_initGrid(BitBucket *bitGrid, rt_uint8_t *data, rt_uint8_t size) {
     rt_memset(data, 0x00, bitGrid->capacityBytes);
 }
 
+/* The buffer is zeroed by bb_initBuffer(), so bits are ORed in: the value is
+   left aligned in a 32-bit accumulator and written a whole byte at a time.
+   "length" is up to 24 bits.
+ */
 static void bb_appendBits(BitBucket *bitBuffer, rt_uint32_t val,
     rt_uint8_t length) {
+    rt_uint32_t offset, acc;
+    rt_uint8_t *data;
+    rt_int8_t left;
+
+    if (!length) return;
+    offset = bitBuffer->bitOffsetOrWidth;
+    data = &bitBuffer->data[offset >> 3];
+    acc = (val << (32 - length)) >> (offset & 0x07);
+    *data++ |= acc >> 24;
+    for (left = length + (offset & 0x07) - 8; left > 0; left -= 8) {
+        acc <<= 8;
+        *data++ = acc >> 24;
+    }
+    bitBuffer->bitOffsetOrWidth = offset + length;
+}
+
+// Byte mode payload: copied as is when byte aligned, else shifted by bytes
+static void bb_appendBytes(BitBucket *bitBuffer, const rt_uint8_t *bytes,
+    rt_uint16_t length) {
     rt_uint32_t offset;
-    rt_int8_t i;
+    rt_uint16_t i;
+    rt_uint8_t *data;
+    rt_uint8_t shift;
 
+    if (!length) return;
     offset = bitBuffer->bitOffsetOrWidth;
-    for (i = length - 1; i >= 0; i--, offset++) {
-        bitBuffer->data[offset >> 3] |= ((val >> i) & 1) << (7 - (offset & 7));
+    data = &bitBuffer->data[offset >> 3];
+    shift = offset & 0x07;
+    if (!shift) {
+        rt_memcpy(data, bytes, length);
+    } else {
+        data[0] |= bytes[0] >> shift;
+        for (i = 1; i < length; i++) {
+            data[i] = (bytes[i - 1] << (8 - shift)) | (bytes[i] >> shift);
+        }
+        data[length] = bytes[length - 1] << (8 - shift);
     }
-    bitBuffer->bitOffsetOrWidth = offset;
+    bitBuffer->bitOffsetOrWidth = offset + 8 * (rt_uint32_t)length;
 }
 
 static void bb_setBit(BitBucket *bitGrid, rt_uint8_t x, rt_uint8_t y,
@@ -196,6 +272,7 @@ static void bb_setBit(BitBucket *bitGrid, rt_uint8_t x, rt_uint8_t y,
     }
 }
 
+#if !QR_LOW_MEMORY
 static rt_bool_t bb_getBit(BitBucket *bitGrid, rt_uint8_t x, rt_uint8_t y) {
     rt_uint32_t offset;
     rt_uint8_t mask;
@@ -204,21 +281,283 @@ static rt_bool_t bb_getBit(BitBucket *bitGrid, rt_uint8_t x, rt_uint8_t y) {
     mask = 1 << (7 - (offset & 0x07));
     return (bitGrid->data[offset >> 3] & mask) != 0;
 }
+#endif
 
-static void bb_invertBit(BitBucket *bitGrid, rt_uint8_t x, rt_uint8_t y,
-    rt_bool_t invert) {
-    rt_uint32_t offset;
-    rt_uint8_t mask;
-    rt_bool_t on;
+/* Returns the 32 bits starting at bit "offset", with the first one in the MSB.
+   Bits past the end of the buffer read as 0.
+ */
+static rt_uint32_t bb_getWord(BitBucket *bitGrid, rt_uint32_t offset) {
+    const rt_uint8_t *data;
+    rt_uint32_t index, word;
+    rt_uint8_t shift, i;
+
+    data = bitGrid->data;
+    index = offset >> 3;
+    shift = offset & 0x07;
+
+    if (index + 5 <= bitGrid->capacityBytes) {
+        word = ((rt_uint32_t)data[index] << 24) | \
+               ((rt_uint32_t)data[index + 1] << 16) | \
+               ((rt_uint32_t)data[index + 2] << 8) | data[index + 3];
+        if (shift) word = (word << shift) | (data[index + 4] >> (8 - shift));
+        return word;
+    }
 
-    offset = y * bitGrid->bitOffsetOrWidth + x;
-    mask = 1 << (7 - (offset & 0x07));
-    on = ((bitGrid->data[offset >> 3] & mask) != 0);
-    if (on ^ invert) {
-        bitGrid->data[offset >> 3] |= mask;
-    } else {
-        bitGrid->data[offset >> 3] &= ~mask;
+    for (word = 0, i = 0; i < 4; i++) {
+        word <<= 8;
+        if (index + i < bitGrid->capacityBytes) word |= data[index + i];
+    }
+    if (shift) {
+        word <<= shift;
+        if (index + 4 < bitGrid->capacityBytes) {
+            word |= data[index + 4] >> (8 - shift);
+        }
+    }
+    return word;
+}
+
+/* XORs the 32 bits of "word" (first one in the MSB) into the buffer, starting
+   at bit "offset". Bits past the end of the buffer must be 0.
+ */
+static void bb_xorWord(BitBucket *bitGrid, rt_uint32_t offset,
+    rt_uint32_t word) {
+    rt_uint8_t *data;
+    rt_uint32_t index;
+    rt_uint8_t shift, i;
+
+    data = bitGrid->data;
+    index = offset >> 3;
+    shift = offset & 0x07;
+
+    for (i = 0; i < 4; i++) {
+        if (index + i >= bitGrid->capacityBytes) return;
+        data[index + i] ^= word >> (24 - 8 * i + shift);
+    }
+    if (shift && (index + 4 < bitGrid->capacityBytes)) {
+        data[index + 4] ^= word << (8 - shift);
+    }
+}
+
+/* Transposes a 32*32 bit matrix in place: row i is word i, with column 0 in
+   the MSB.
+   See: Hacker's Delight, 7-3 "Transposing a Bit Matrix"
+ */
+static void bb_transpose(rt_uint32_t *matrix) {
+    rt_uint32_t mask, t;
+    rt_uint8_t j, k;
+
+    mask = 0x0000FFFF;
+    for (j = 16; j != 0; j >>= 1, mask ^= mask << j) {
+        for (k = 0; k < 32; k = (k + j + 1) & ~j) {
+            t = (matrix[k] ^ (matrix[k + j] >> j)) & mask;
+            matrix[k] ^= t;
+            matrix[k + j] ^= t << j;
+        }
+    }
+}
+
+#if LOCK_VERSION == 0 || LOCK_VERSION > 1
+/* Fills the row (and column) coordinates of the alignment pattern centers and
+   returns their count, 0 for version 1.
+ */
+static rt_uint8_t getAlignmentPositions(rt_uint8_t version,
+    rt_uint8_t *positions) {
+#if LOCK_VERSION == 0
+    rt_uint8_t alignCount, step, i, pos;
+
+    if (version < 2) return 0;
+    alignCount = version / 7 + 2;
+    if (version != 32) { // ceil((size - 13) / (2*numAlign - 2)) * 2
+        step = (version * 4 + alignCount * 2 + 1) / \
+               (2 * alignCount - 2) * 2;
+    } else { // C-C-C-Combo breaker!
+        step = 26;
+    }
+
+    positions[0] = 6;
+    for (i = alignCount - 1, pos = version * 4 + 17 - 7; i > 0; i--,
+        pos -= step) {
+        positions[i] = pos;
+    }
+    return alignCount;
+
+#else
+    (void)version;
+    rt_memcpy(positions, ALIGNMENT_POSITIONS, sizeof(ALIGNMENT_POSITIONS));
+    return sizeof(ALIGNMENT_POSITIONS);
+
+#endif
+}
+#endif
+
+/* Function modules
+
+   Without QR_LOW_MEMORY they are marked in a grid as they are drawn. With it
+   they are worked out for each row from the version: the finders with their
+   separators and the format bits, the timing patterns, the version bits and
+   the alignment patterns. That saves the grid (up to 3.9 KB) at the cost of
+   slower lookups.
+ */
+#if QR_LOW_MEMORY
+#define FM_ROW_WORDS                ((40 * 4 + 17 + 31) / 32)
+
+typedef struct FunctionMap {
+    rt_uint8_t size;
+    rt_uint8_t version;
+    rt_uint8_t alignCount;
+    rt_uint8_t alignPosition[7];    // Up to version 40
+    /* Columns of the alignment patterns crossing the rows of the first, the
+       last and the other alignment positions
+     */
+    rt_uint32_t alignWords[3][FM_ROW_WORDS];
+} FunctionMap;
+
+// Columns "from" to "to" within the 32 columns from x (column x in the MSB)
+static rt_uint32_t fm_getSpan(rt_uint8_t x, rt_int16_t from, rt_int16_t to) {
+    if (from < x) from = x;
+    if (to > x + 31) to = x + 31;
+    if (from > to) return 0;
+    return (0xFFFFFFFF >> (from - x)) & (0xFFFFFFFF << (x + 31 - to));
+}
+
+static void fm_init(FunctionMap *map, rt_uint8_t version) {
+    rt_uint8_t kind, j, w;
+
+    map->size = 4 * version + 17;
+    map->version = version;
+    #if LOCK_VERSION == 0 || LOCK_VERSION > 1
+        map->alignCount = getAlignmentPositions(version, map->alignPosition);
+    #else
+        map->alignCount = 0;
+    #endif
+
+    // The finder corners have no alignment pattern
+    rt_memset(map->alignWords, 0x00, sizeof(map->alignWords));
+    for (kind = 0; kind < 3; kind++) {
+        for (j = 0; j < map->alignCount; j++) {
+            if (((0 == kind) && ((0 == j) || (map->alignCount - 1 == j))) || \
+                ((1 == kind) && (0 == j))) {
+                continue;
+            }
+            for (w = 0; w * 32 < map->size; w++) {
+                map->alignWords[kind][w] |= fm_getSpan(w * 32,
+                    map->alignPosition[j] - 2, map->alignPosition[j] + 2);
+            }
+        }
+    }
+}
+
+/* Returns the function modules of row y, columns x to x + 31 (column x in the
+   MSB). x must be a multiple of 32; columns past the row read as 0.
+ */
+static rt_uint32_t fm_getWord(FunctionMap *map, rt_uint8_t x, rt_uint8_t y) {
+    rt_uint32_t word;
+    rt_uint8_t size, i;
+
+    size = map->size;
+    if (6 == y) return fm_getSpan(x, 0, size - 1);
+
+    // Vertical timing, finders with separators and format bits
+    word = fm_getSpan(x, 6, 6);
+    if (y < 9) {
+        word |= fm_getSpan(x, 0, 8) | fm_getSpan(x, size - 8, size - 1);
+    } else if (y >= size - 8) {
+        word |= fm_getSpan(x, 0, 8);
     }
+
+    // Version bits
+    if (map->version >= 7) {
+        if (y < 6) {
+            word |= fm_getSpan(x, size - 11, size - 9);
+        } else if ((y >= size - 11) && (y <= size - 9)) {
+            word |= fm_getSpan(x, 0, 5);
+        }
+    }
+
+    // Alignment patterns
+    for (i = 0; i < map->alignCount; i++) {
+        if (abs(y - map->alignPosition[i]) > 2) continue;
+        word |= map->alignWords[(0 == i) ? 0 : \
+            (map->alignCount - 1 == i) ? 1 : 2][x >> 5];
+        break;
+    }
+    return word;
+}
+
+/* Returns the function modules of columns x - 1 (bit 1) and x (bit 0) of
+   row y, the column pair of the codeword placement
+ */
+static rt_uint8_t fm_getPair(FunctionMap *map, rt_uint8_t x, rt_uint8_t y) {
+    rt_uint32_t word;
+    rt_uint8_t left;
+
+    left = x - 1;
+    word = fm_getWord(map, left & ~0x1f, y);
+    if (!(x & 0x1f)) return ((word & 1) << 1) | (fm_getWord(map, x, y) >> 31);
+    return (word >> (30 - (left & 0x1f))) & 0x03;
+}
+
+#else /* QR_LOW_MEMORY */
+typedef BitBucket FunctionMap;
+
+static rt_uint32_t fm_getWord(FunctionMap *map, rt_uint8_t x, rt_uint8_t y) {
+    return bb_getWord(map, y * map->bitOffsetOrWidth + x);
+}
+
+static rt_uint8_t fm_getPair(FunctionMap *map, rt_uint8_t x, rt_uint8_t y) {
+    return (bb_getBit(map, x - 1, y) << 1) | bb_getBit(map, x, y);
+}
+#endif /* QR_LOW_MEMORY */
+
+/* The 8 mask patterns repeat every 6 columns and every 12 rows. Each entry is
+   the pattern of columns 0 to 5 (column 0 in bit 5) for one row (y % 12).
+ */
+static const rt_uint8_t MASK_PATTERNS[8][12] = {
+    {0x2a, 0x15, 0x2a, 0x15, 0x2a, 0x15, 0x2a, 0x15, 0x2a, 0x15, 0x2a, 0x15},  // (x + y) % 2 == 0
+    {0x3f, 0x00, 0x3f, 0x00, 0x3f, 0x00, 0x3f, 0x00, 0x3f, 0x00, 0x3f, 0x00},  // y % 2 == 0
+    {0x24, 0x24, 0x24, 0x24, 0x24, 0x24, 0x24, 0x24, 0x24, 0x24, 0x24, 0x24},  // x % 3 == 0
+    {0x24, 0x09, 0x12, 0x24, 0x09, 0x12, 0x24, 0x09, 0x12, 0x24, 0x09, 0x12},  // (x + y) % 3 == 0
+    {0x38, 0x38, 0x07, 0x07, 0x38, 0x38, 0x07, 0x07, 0x38, 0x38, 0x07, 0x07},  // (x / 3 + y / 2) % 2 == 0
+    {0x3f, 0x20, 0x24, 0x2a, 0x24, 0x20, 0x3f, 0x20, 0x24, 0x2a, 0x24, 0x20},  // x * y % 2 + x * y % 3 == 0
+    {0x3f, 0x38, 0x36, 0x2a, 0x2d, 0x23, 0x3f, 0x38, 0x36, 0x2a, 0x2d, 0x23},  // (x * y % 2 + x * y % 3) % 2 == 0
+    {0x2a, 0x07, 0x23, 0x15, 0x38, 0x1c, 0x2a, 0x07, 0x23, 0x15, 0x38, 0x1c},  // ((x + y) % 2 + x * y % 3) % 2 == 0
+};
+
+/* Returns the mask pattern of row y, columns x to x + 31 (column x in the MSB).
+   x must be a multiple of 32.
+ */
+static rt_uint32_t mask_getWord(rt_uint8_t mask, rt_uint8_t y, rt_uint8_t x) {
+    rt_uint32_t pattern, word;
+    rt_uint8_t phase;
+
+    // Columns 0 to 31: 5 copies of the pattern, then its first 2 bits
+    pattern = MASK_PATTERNS[mask][y % 12];
+    word = (pattern * 0x04104104) | (pattern >> 4);
+
+    /* 32 % 6 == 2, so column x starts at phase 0, 2 or 4 of the pattern. The
+       bits shifted in are those of columns 32 onwards, i.e. of phase 2.
+     */
+    phase = x % 6;
+    if (phase) word = (word << phase) | ((word << 2) >> (32 - phase));
+    return word;
+}
+
+static rt_uint8_t mask_getBit(rt_uint8_t mask, rt_uint8_t x, rt_uint8_t y) {
+    return (mask_getWord(mask, y, x & ~0x1f) >> (31 - (x & 0x1f))) & 1;
+}
+
+/* Returns 32 modules of row y starting at column x (a multiple of 32), as they
+   will be once "mask" is applied. No mask is applied without "isFunction".
+ */
+static rt_uint32_t mask_getModulesWord(BitBucket *modules,
+    FunctionMap *isFunction, rt_uint8_t mask, rt_uint8_t x, rt_uint8_t y) {
+    rt_uint32_t word;
+
+    word = bb_getWord(modules, y * modules->bitOffsetOrWidth + x);
+    if (isFunction) {
+        word ^= mask_getWord(mask, y, x) & ~fm_getWord(isFunction, x, y);
+    }
+    return word;
 }
 
 /* XORs the data modules in this QR Code with the given mask pattern. Due to
@@ -227,42 +566,39 @@ static void bb_invertBit(BitBucket *bitGrid, rt_uint8_t x, rt_uint8_t y,
    This means it is possible to apply a mask, undo it, and try another mask.
    Note that a final well-formed QR Code symbol needs exactly one mask applied
    (not zero, not two, etc.).
+   The pattern is applied 32 modules at a time.
  */
-static void applyMask(BitBucket *modules, BitBucket *isFunction,
+static void applyMask(BitBucket *modules, FunctionMap *isFunction,
     rt_uint8_t mask) {
+    rt_uint32_t offset, word;
     rt_uint8_t x, y, size;
-    rt_bool_t invert;
 
     size = modules->bitOffsetOrWidth;
     for (y = 0; y < size; y++) {
-        for (x = 0; x < size; x++) {
-            if (bb_getBit(isFunction, x, y)) continue;
-
-            if (0 == mask) invert = (x + y) % 2 == 0;
-            else if (1 == mask) invert = y % 2 == 0;
-            else if (2 == mask) invert = x % 3 == 0;
-            else if (3 == mask) invert = (x + y) % 3 == 0;
-            else if (4 == mask) invert = (x / 3 + y / 2) % 2 == 0;
-            else if (5 == mask) invert = x * y % 2 + x * y % 3 == 0;
-            else if (6 == mask) invert = (x * y % 2 + x * y % 3) % 2 == 0;
-            else if (7 == mask) invert = ((x + y) % 2 + x * y % 3) % 2 == 0;
-            else
-                invert = 0;
-            bb_invertBit(modules, x, y, invert);
+        for (x = 0; x < size; x += 32) {
+            offset = y * size + x;
+            word = mask_getWord(mask, y, x) & ~fm_getWord(isFunction, x, y);
+            // The bits past the end of the row belong to the next one
+            if (size - x < 32) word &= ~(0xFFFFFFFF >> (size - x));
+            bb_xorWord(modules, offset, word);
         }
     }
 }
 
-static void setFunctionModule(BitBucket *modules, BitBucket *isFunction,
+static void setFunctionModule(BitBucket *modules, FunctionMap *isFunction,
     rt_uint8_t x, rt_uint8_t y, rt_bool_t on) {
     bb_setBit(modules, x, y, on);
-    bb_setBit(isFunction, x, y, RT_TRUE);
+    #if QR_LOW_MEMORY
+        (void)isFunction;
+    #else
+        bb_setBit(isFunction, x, y, RT_TRUE);
+    #endif
 }
 
 /* Draws a 9*9 finder pattern including the border separator, with the center
    module at (x, y).
  */
-static void drawFinderPattern(BitBucket *modules, BitBucket *isFunction,
+static void drawFinderPattern(BitBucket *modules, FunctionMap *isFunction,
     rt_uint8_t x, rt_uint8_t y) {
     rt_uint8_t size, dist;
     rt_int8_t i, j;
@@ -282,8 +618,9 @@ static void drawFinderPattern(BitBucket *modules, BitBucket *isFunction,
     }
 }
 
+#if LOCK_VERSION == 0 || LOCK_VERSION > 1
 /* Draws a 5*5 alignment pattern, with the center module at (x, y). */
-static void drawAlignmentPattern(BitBucket *modules, BitBucket *isFunction,
+static void drawAlignmentPattern(BitBucket *modules, FunctionMap *isFunction,
     rt_uint8_t x, rt_uint8_t y) {
     rt_int8_t i, j;
 
@@ -294,11 +631,12 @@ static void drawAlignmentPattern(BitBucket *modules, BitBucket *isFunction,
         }
     }
 }
+#endif
 
 /* Draws two copies of the format bits (with its own error correction code)
    based on the given mask and this object's error correction level field.
  */
-static void drawFormatBits(BitBucket *modules, BitBucket *isFunction,
+static void drawFormatBits(BitBucket *modules, FunctionMap *isFunction,
     rt_uint8_t ecc, rt_uint8_t mask) {
     rt_uint8_t size, i;
     rt_uint32_t data, rem;
@@ -342,17 +680,19 @@ static void drawFormatBits(BitBucket *modules, BitBucket *isFunction,
    based on this object's version field (which only has an effect for
    7 <= version <= 40).
  */
-static void drawVersion(BitBucket *modules, BitBucket *isFunction,
+static void drawVersion(BitBucket *modules, FunctionMap *isFunction,
     rt_uint8_t version) {
+#if LOCK_VERSION != 0 && LOCK_VERSION < 7
+    (void)modules;
+    (void)isFunction;
+    (void)version;
+
+#else
     rt_int8_t size;
     rt_uint8_t i, a, b;
     rt_bool_t bit;
     rt_uint32_t rem, data;
 
-#if LOCK_VERSION != 0 && LOCK_VERSION < 7
-    return;
-
-#else
     if (version < 7) return;
 
     size = modules->bitOffsetOrWidth;
@@ -376,15 +716,13 @@ static void drawVersion(BitBucket *modules, BitBucket *isFunction,
 #endif
 }
 
-static void drawFunctionPatterns(BitBucket *modules, BitBucket *isFunction,
+static void drawFunctionPatterns(BitBucket *modules, FunctionMap *isFunction,
     rt_uint8_t version, rt_uint8_t ecc) {
     rt_uint8_t i, size;
     #if LOCK_VERSION == 0 || LOCK_VERSION > 1
         rt_uint8_t alignCount;
-        rt_uint8_t step;
-        rt_uint8_t alignPositionIndex;
-        rt_uint8_t *alignPosition;
-        rt_uint8_t j, pos;
+        rt_uint8_t alignPosition[7];    // Up to version 40
+        rt_uint8_t j;
     #endif
 
     // Draw the horizontal and vertical timing patterns
@@ -401,44 +739,20 @@ static void drawFunctionPatterns(BitBucket *modules, BitBucket *isFunction,
     drawFinderPattern(modules, isFunction, 3, size - 4);
 
     #if LOCK_VERSION == 0 || LOCK_VERSION > 1
-        if (version > 1) {
-            // Draw the numerous alignment patterns
-            alignCount = version / 7 + 2;
-            if (version != 32) { // ceil((size - 13) / (2*numAlign - 2)) * 2
-                step = (version * 4 + alignCount * 2 + 1) / \
-                       (2 * alignCount - 2) * 2;
-            } else { // C-C-C-Combo breaker!
-                step = 26;
-            }
-            
-            alignPositionIndex = alignCount - 1;
-            alignPosition = (rt_uint8_t *)rt_calloc(1, alignCount);
-            if (!alignPosition) {
-                LOG_W("No Memory");
-                return;
-            }
-
-            alignPosition[0] = 6;
-            size = version * 4 + 17;
-            for (i = 0, pos = size - 7; i < alignCount - 1; i++, pos -= step) {
-                alignPosition[alignPositionIndex--] = pos;
-            }
-
-            for (i = 0; i < alignCount; i++) {
-                for (j = 0; j < alignCount; j++) {
-                    if ((i == 0 && j == 0) || \
-                        (i == 0 && j == alignCount - 1) || \
-                        (i == alignCount - 1 && j == 0)) {
-                        continue;  // Skip the three finder corners
-                    } else {
-                        drawAlignmentPattern(modules, isFunction,
-                            alignPosition[i], alignPosition[j]);
-                    }
+        // Draw the numerous alignment patterns
+        alignCount = getAlignmentPositions(version, alignPosition);
+        for (i = 0; i < alignCount; i++) {
+            for (j = 0; j < alignCount; j++) {
+                if ((i == 0 && j == 0) || \
+                    (i == 0 && j == alignCount - 1) || \
+                    (i == alignCount - 1 && j == 0)) {
+                    continue;  // Skip the three finder corners
+                } else {
+                    drawAlignmentPattern(modules, isFunction,
+                        alignPosition[i], alignPosition[j]);
                 }
             }
-            rt_free(alignPosition);
-    }
-
+        }
     #endif
 
     // Draw configuration data
@@ -447,21 +761,63 @@ static void drawFunctionPatterns(BitBucket *modules, BitBucket *isFunction,
     drawVersion(modules, isFunction, version);
 }
 
+/* Reads the codewords in their interleaved order, from the data codewords
+   block after block followed by the ECC ones, already interleaved (see
+   performErrorCorrection()). Past them it reads the zeroed remainder byte.
+ */
+typedef struct CodewordReader {
+    const rt_uint8_t *data;
+    rt_uint16_t index;              // Next codeword, in interleaved order
+    rt_uint16_t dataCount;
+    rt_uint16_t blockStart;         // Of the block of the next data codeword
+    rt_uint8_t block;
+    rt_uint8_t column;              // Of the next data codeword in its block
+    rt_uint8_t numBlocks;
+    rt_uint8_t numShortBlocks;
+    rt_uint8_t shortDataBlockLen;
+} CodewordReader;
+
+// Index in "data" of the next codeword
+static rt_uint16_t cw_nextIndex(CodewordReader *reader) {
+    rt_uint16_t result;
+
+    if (reader->index >= reader->dataCount) return reader->index++;
+
+    result = reader->blockStart + reader->column;
+    reader->index++;
+    if (++reader->block < reader->numBlocks) {
+        // Long blocks have one more data codeword
+        reader->blockStart += reader->shortDataBlockLen + \
+            (reader->block > reader->numShortBlocks);
+    } else if (++reader->column < reader->shortDataBlockLen) {
+        reader->block = 0;
+        reader->blockStart = 0;
+    } else {
+        // The last column is only in the long blocks
+        reader->block = reader->numShortBlocks;
+        reader->blockStart = reader->numShortBlocks * \
+            reader->shortDataBlockLen;
+    }
+    return result;
+}
+
+static rt_uint8_t cw_next(CodewordReader *reader) {
+    return reader->data[cw_nextIndex(reader)];
+}
+
 /* Draws the given sequence of 8-bit codewords (data and error correction)
    onto the entire data area of this QR Code symbol. Function modules need to
    be marked off before this is called.
  */
-static void drawCodewords(BitBucket *modules, BitBucket *isFunction,
-    BitBucket *codewords) {
-    rt_uint32_t bitLength, i, j;
-    rt_uint8_t *data;
+static void drawCodewords(BitBucket *modules, FunctionMap *isFunction,
+    CodewordReader *codewords, rt_uint32_t bitLength) {
+    rt_uint32_t i, j;
+    rt_uint8_t byte, funcs;
     rt_uint8_t size, vert, x, y;
     rt_int16_t right;
-    rt_bool_t upwards;
     
-    bitLength = codewords->bitOffsetOrWidth;
-    data = codewords->data;
     size = modules->bitOffsetOrWidth;
+    byte = 0;
     i = 0; // Bit index into the data
 
     // Do the funny zigzag scan
@@ -470,13 +826,15 @@ static void drawCodewords(BitBucket *modules, BitBucket *isFunction,
         if (right == 6) right = 5;
         
         for (vert = 0; vert < size; vert++) { // Vertical counter
+            // Both columns of a pair go the same way (column 6 is skipped)
+            y = (((right & 2) == 0) ^ (right < 6)) ? \
+                size - 1 - vert : vert;  // Actual y coordinate
+            funcs = fm_getPair(isFunction, right, y);
             for (j = 0; j < 2; j++) {
                 x = right - j;  // Actual x coordinate
-                upwards = ((right & 2) == 0) ^ (x < 6);
-                y = upwards ? size - 1 - vert : vert;  // Actual y coordinate
-                if (!bb_getBit(isFunction, x, y) && i < bitLength) {
-                    bb_setBit(modules, x, y,
-                        ((data[i >> 3] >> (7 - (i & 7))) & 1) != 0);
+                if (!((funcs >> j) & 1) && i < bitLength) {
+                    if (!(i & 7)) byte = cw_next(codewords);
+                    bb_setBit(modules, x, y, ((byte >> (7 - (i & 7))) & 1) != 0);
                     i++;
                 }
                 /* If there are any remainder bits (0 to 7), they are already
@@ -488,101 +846,377 @@ static void drawCodewords(BitBucket *modules, BitBucket *isFunction,
     }
 }
 
-#define PENALTY_N1      3
-#define PENALTY_N2      3
-#define PENALTY_N3     40
-#define PENALTY_N4     10
+#if QR_TEMPLATE_CACHE
+/* Template cache
 
-/* Calculates and returns the penalty score based on state of this QR Code's
-   current modules.
-   This is used by the automatic mask choice algorithm to find the mask pattern
-   that yields the lowest score.
+   A template is the output of drawFunctionPatterns() for a version: the
+   modules grid followed by the isFunction grid (none with QR_LOW_MEMORY),
+   and with QR_PLACEMENT_MAP the placement runs of the data modules. The
+   format bits are included but always redrawn with the chosen mask. Without
+   the cache, the codewords are placed by the zigzag scan.
+
+   Templates are immutable once in the cache. Slots are only touched with the
+   scheduler locked, and an encode holds its template ("users") so it is not
+   replaced meanwhile; the least recently used free one is.
  */
-// @TODO: This can be optimized by working with the bytes instead of bits.
-static rt_uint32_t getPenaltyScore(BitBucket *modules) {
-    rt_uint32_t result;
-    rt_uint8_t size, x, y, runX, runY;
-    rt_uint16_t black, total, k;
+#define PLACEMENT_MAP               QR_PLACEMENT_MAP
 
-    result = 0;
-    size = modules->bitOffsetOrWidth;
+#if PLACEMENT_MAP
+/* A run of rows of a column pair, in the zigzag order of drawCodewords(). The
+   bits go to the right module then the left one of each row, or to one of
+   them only.
+ */
+#define PLACE_UP                    0x01
+#define PLACE_RIGHT                 0x02
+#define PLACE_LEFT                  0x04
+
+typedef struct PlacementRun {
+    rt_uint16_t offset;     // Grid offset of the right module of the first row
+    rt_uint8_t rows;
+    rt_uint8_t flags;
+} PlacementRun;
+#endif
 
-    // Adjacent modules in row having same color
-    for (y = 0; y < size; y++) {
-        rt_bool_t colorX, cx;
-        colorX = bb_getBit(modules, 0, y);
-        for (x = 1, runX = 1; x < size; x++) {
-            cx = bb_getBit(modules, x, y);
-            if (cx != colorX) {
-                colorX = cx;
-                runX = 1;
-            } else {
-                runX++;
-                if (runX == 5) {
-                    result += PENALTY_N1;
-                } else if (runX > 5) {
-                    result++;
-                }
+typedef struct TemplateEntry {
+    rt_uint8_t version;
+    rt_uint8_t users;
+    rt_uint32_t lastUse;
+    rt_uint8_t *grids;
+#if PLACEMENT_MAP
+    PlacementRun *runs;
+    rt_uint16_t runCount;
+#endif
+} TemplateEntry;
+
+static TemplateEntry templateCache[QR_TEMPLATE_CACHE];
+static rt_uint32_t templateClock;
+
+#if PLACEMENT_MAP
+// Walks the zigzag of drawCodewords(); returns the number of runs
+static rt_uint16_t pl_build(FunctionMap *isFunction, rt_uint8_t size,
+    PlacementRun *runs) {
+    PlacementRun run;
+    rt_uint16_t count;
+    rt_uint8_t vert, y, flags, funcs;
+    rt_int16_t right;
+
+    count = 0;
+    run.rows = 0;
+    for (right = size - 1; right >= 1; right -= 2) {
+        if (right == 6) right = 5;
+
+        for (vert = 0; vert < size; vert++) {
+            // Both columns of a pair go the same way (column 6 is skipped)
+            y = (((right & 2) == 0) ^ (right < 6)) ? size - 1 - vert : vert;
+            flags = (y != vert) ? PLACE_UP : 0;
+            funcs = fm_getPair(isFunction, right, y);
+            if (!(funcs & 0x01)) flags |= PLACE_RIGHT;
+            if (!(funcs & 0x02)) flags |= PLACE_LEFT;
+
+            if (run.rows && (vert > 0) && (run.flags == flags) && \
+                (run.rows < 0xff)) {
+                run.rows++;
+                continue;
+            }
+            if (run.rows) {
+                if (runs) runs[count] = run;
+                count++;
+            }
+            run.rows = 0;
+            if (flags & (PLACE_RIGHT | PLACE_LEFT)) {
+                run.offset = y * size + right;
+                run.rows = 1;
+                run.flags = flags;
             }
         }
     }
+    if (run.rows) {
+        if (runs) runs[count] = run;
+        count++;
+    }
+    return count;
+}
 
-    // Adjacent modules in column having same color
-    for (x = 0; x < size; x++) {
-        rt_bool_t colorY, cy;
-        colorY = bb_getBit(modules, x, 0);
-        for (y = 1, runY = 1; y < size; y++) {
-            cy = bb_getBit(modules, x, y);
-            if (cy != colorY) {
-                colorY = cy;
-                runY = 1;
-            } else {
-                runY++;
-                if (runY == 5) {
-                    result += PENALTY_N1;
-                } else if (runY > 5) {
-                    result++;
+/* The data modules are still white, so the bits are ORed in. The codewords
+   are read a byte at a time into a reservoir, and a row of a column pair takes
+   2 bits at once. The runs hold exactly as many modules as the codewords have
+   bits.
+ */
+static void pl_place(BitBucket *modules, const PlacementRun *runs,
+    rt_uint16_t count, CodewordReader *codewords, rt_uint32_t bitLength) {
+    rt_uint8_t *grid;
+    rt_uint32_t reservoir, offset;
+    rt_int32_t step;
+    rt_uint16_t bits, bytes;
+    rt_uint8_t available, rows, pair;
+
+    bytes = bb_getBufferSizeBytes(bitLength);
+    grid = modules->data;
+    reservoir = 0;
+    available = 0;
+    for ( ; count--; runs++) {
+        step = modules->bitOffsetOrWidth;
+        if (runs->flags & PLACE_UP) step = -step;
+        offset = runs->offset;
+
+        if ((runs->flags & (PLACE_RIGHT | PLACE_LEFT)) == \
+            (PLACE_RIGHT | PLACE_LEFT)) {
+            for (rows = runs->rows; rows; rows--, offset += step) {
+                if (available < 2) {
+                    if (bytes) {
+                        reservoir |= (rt_uint32_t)cw_next(codewords) << \
+                            (24 - available);
+                        bytes--;
+                    }
+                    available += 8;
+                }
+                // The first bit to the right module, the next to the left one
+                pair = reservoir >> 30;
+                pair = ((pair & 0x01) << 1) | (pair >> 1);
+                reservoir <<= 2;
+                available -= 2;
+
+                bits = (rt_uint16_t)pair << (14 - ((offset - 1) & 0x07));
+                grid[(offset - 1) >> 3] |= bits >> 8;
+                if (bits & 0xff) grid[offset >> 3] |= bits & 0xff;
+            }
+        } else {
+            if (runs->flags & PLACE_LEFT) offset--;
+            for (rows = runs->rows; rows; rows--, offset += step) {
+                if (!available) {
+                    if (bytes) {
+                        reservoir |= (rt_uint32_t)cw_next(codewords) << 24;
+                        bytes--;
+                    }
+                    available += 8;
                 }
+                if (reservoir & 0x80000000)
+                    grid[offset >> 3] |= 0x80 >> (offset & 0x07);
+                reservoir <<= 1;
+                available--;
             }
         }
     }
+}
+#endif /* PLACEMENT_MAP */
+
+// Returns the held template of the version, or RT_NULL
+static TemplateEntry *tpl_acquire(rt_uint8_t version) {
+    TemplateEntry *entry;
+    rt_uint8_t i;
+
+    entry = RT_NULL;
+    rt_enter_critical();
+    for (i = 0; i < QR_TEMPLATE_CACHE; i++) {
+        if (templateCache[i].grids && (templateCache[i].version == version)) {
+            entry = &templateCache[i];
+            entry->users++;
+            entry->lastUse = ++templateClock;
+            break;
+        }
+    }
+    rt_exit_critical();
+    return entry;
+}
 
-    black = 0;
-    for (y = 0; y < size; y++) {
-        rt_uint16_t bitsRow = 0;
-        rt_uint16_t bitsCol = 0;
+static void tpl_release(TemplateEntry *entry) {
+    rt_enter_critical();
+    entry->users--;
+    rt_exit_critical();
+}
 
-        for (x = 0; x < size; x++) {
-            rt_bool_t color = bb_getBit(modules, x, y);
+static void tpl_load(TemplateEntry *entry, BitBucket *modules,
+    FunctionMap *isFunction) {
+    rt_memcpy(modules->data, entry->grids, modules->capacityBytes);
+    #if QR_LOW_MEMORY
+        (void)isFunction;
+    #else
+        rt_memcpy(isFunction->data, entry->grids + modules->capacityBytes,
+            isFunction->capacityBytes);
+    #endif
+}
 
-            // 2*2 blocks of modules having same color
-            if (x > 0 && y > 0) {
-                rt_bool_t colorUL = bb_getBit(modules, x - 1, y - 1);
-                rt_bool_t colorUR = bb_getBit(modules, x, y - 1);
-                rt_bool_t colorL = bb_getBit(modules, x - 1, y);
+/* Stores the drawn function patterns and returns them held, or RT_NULL. The
+   cache is best effort: without memory or a free slot nothing is stored.
+ */
+static TemplateEntry *tpl_store(BitBucket *modules, FunctionMap *isFunction,
+    rt_uint8_t version) {
+    TemplateEntry *entry;
+    rt_uint8_t *grids, *old;
+    rt_uint32_t gridBytes;
+    rt_uint8_t i;
+    #if PLACEMENT_MAP
+        rt_uint16_t runCount;
+    #endif
 
-                if (color == colorUL && color == colorUR && color == colorL) {
-                    result += PENALTY_N2;
-                }
-            }
+    gridBytes = modules->capacityBytes;
+    #if !QR_LOW_MEMORY
+        gridBytes += isFunction->capacityBytes;
+    #endif
+    #if PLACEMENT_MAP
+        // The runs go first to keep them aligned
+        runCount = pl_build(isFunction, modules->bitOffsetOrWidth, RT_NULL);
+        grids = (rt_uint8_t *)rt_malloc(runCount * sizeof(PlacementRun) + \
+            gridBytes);
+        if (!grids) return RT_NULL;
+        pl_build(isFunction, modules->bitOffsetOrWidth, (PlacementRun *)grids);
+        old = grids;
+        grids += runCount * sizeof(PlacementRun);
+    #else
+        grids = (rt_uint8_t *)rt_malloc(gridBytes);
+        if (!grids) return RT_NULL;
+        old = grids;
+    #endif
+    rt_memcpy(grids, modules->data, modules->capacityBytes);
+    #if !QR_LOW_MEMORY
+        rt_memcpy(grids + modules->capacityBytes, isFunction->data,
+            isFunction->capacityBytes);
+    #endif
+
+    entry = RT_NULL;
+    rt_enter_critical();
+    for (i = 0; i < QR_TEMPLATE_CACHE; i++) {
+        if (templateCache[i].users) continue;
+        if (!entry || (templateCache[i].lastUse < entry->lastUse))
+            entry = &templateCache[i];
+    }
+    if (entry) {
+        old = entry->grids;
+        #if PLACEMENT_MAP
+            if (old) old = (rt_uint8_t *)entry->runs;
+            entry->runs = (PlacementRun *)(grids - \
+                runCount * sizeof(PlacementRun));
+            entry->runCount = runCount;
+        #endif
+        entry->grids = grids;
+        entry->version = version;
+        entry->users = 1;
+        entry->lastUse = ++templateClock;
+    }
+    rt_exit_critical();
 
-            // Finder-like pattern in rows and columns
-            bitsRow = ((bitsRow << 1) & 0x7FF) | color;
-            bitsCol = ((bitsCol << 1) & 0x7FF) | bb_getBit(modules, y, x);
+    if (old) rt_free(old);
+    return entry;
+}
+#endif /* QR_TEMPLATE_CACHE */
 
-            // Needs 11 bits accumulated
-            if (x >= 10) {
-                if (bitsRow == 0x05D || bitsRow == 0x5D0) {
-                    result += PENALTY_N3;
-                }
-                if (bitsCol == 0x05D || bitsCol == 0x5D0) {
-                    result += PENALTY_N3;
-                }
+
+#define PENALTY_N1      3
+#define PENALTY_N2      3
+#define PENALTY_N3     40
+#define PENALTY_N4     10
+
+// Words of a row (or column) of the largest symbol
+#define PN_LINE_WORDS   ((40 * 4 + 17 + 31) / 32)
+
+#if defined(__GNUC__)
+# define pn_popCount(x)             __builtin_popcount(x)
+#else
+static rt_uint8_t pn_popCount(rt_uint32_t x) {
+    x = x - ((x >> 1) & 0x55555555);
+    x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+    x = (x + (x >> 4)) & 0x0F0F0F0F;
+    return (x * 0x01010101) >> 24;
+}
+#endif
+
+/* Returns the bits of a line word (whose first bit is at line position "pos")
+   that fall in the line positions [from, size).
+ */
+static rt_uint32_t pn_getValidBits(rt_uint16_t pos, rt_uint8_t from,
+    rt_uint8_t size) {
+    rt_uint32_t valid;
+
+    valid = 0xFFFFFFFF;
+    if (pos < from) valid >>= from - pos;
+    if (pos + 32 > size) valid &= ~(0xFFFFFFFF >> (size - pos));
+    return valid;
+}
+
+/* Scores the runs (N1) and finder-like patterns (N3) ending in one 32-bit
+   word of a row or column. "prev" is the preceding word of the same line (0
+   for the first one) and "pos" is the line position of the MSB of "cur".
+ */
+static rt_uint32_t pn_scoreLineWord(rt_uint32_t cur, rt_uint32_t prev,
+    rt_uint16_t pos, rt_uint8_t size) {
+    rt_uint32_t diff, run5, run6, finder1, finder2, shifted, pattern;
+    rt_uint8_t d;
+
+    // Bit i of PN_SHIFT(d) is the module d positions before bit i
+    #define PN_SHIFT(d)     ((cur >> (d)) | (prev << (32 - (d))))
+
+    /* A run of r >= 5 modules scores N1 + (r - 5). It has (r - 4) modules
+       ending a run of at least 5 (run5) and (r - 5) ending a run of at least
+       6 (run6), so the score is N1 * run5 - (N1 - 1) * run6.
+     */
+    diff = (cur ^ PN_SHIFT(1)) | (cur ^ PN_SHIFT(2)) | \
+           (cur ^ PN_SHIFT(3)) | (cur ^ PN_SHIFT(4));
+    run5 = ~diff & pn_getValidBits(pos, 4, size);
+    run6 = run5 & ~(cur ^ PN_SHIFT(5)) & pn_getValidBits(pos, 5, size);
+
+    // 11-module windows ending at each bit, matching 0x05D or 0x5D0
+    finder1 = finder2 = pn_getValidBits(pos, 10, size);
+    for (d = 0; d <= 10; d++) {
+        shifted = d ? PN_SHIFT(d) : cur;
+        pattern = ((0x05D >> d) & 1) - 1;  // 0 to match 1, ~0 to match 0
+        finder1 &= shifted ^ pattern;
+        pattern = ((0x5D0 >> d) & 1) - 1;
+        finder2 &= shifted ^ pattern;
+    }
+
+    #undef PN_SHIFT
+
+    return PENALTY_N1 * pn_popCount(run5) - \
+           (PENALTY_N1 - 1) * pn_popCount(run6) + \
+           PENALTY_N3 * (pn_popCount(finder1) + pn_popCount(finder2));
+}
+
+/* Calculates and returns the penalty score based on state of this QR Code's
+   current modules.
+   This is used by the automatic mask choice algorithm to find the mask pattern
+   that yields the lowest score.
+   The modules are scored as if "mask" was applied (see mask_getModulesWord()),
+   so nothing has to be undone afterwards. Rows are read 32 modules at a time;
+   columns are read from 32*32 tiles transposed on the fly.
+   As the score only grows, scoring stops once it is above "limit", and the
+   partial score is returned.
+ */
+static rt_uint32_t getPenaltyScore(BitBucket *modules, FunctionMap *isFunction,
+    rt_uint8_t mask, rt_uint32_t limit) {
+    rt_uint32_t result, cur, prev, both, none, bothPrev, nonePrev, blocks;
+    rt_uint32_t above[PN_LINE_WORDS], tile[32], tilePrev[32];
+    rt_uint16_t black, total, k, pos;
+    rt_uint8_t size, x, y, w, i;
+
+    result = 0;
+    black = 0;
+    size = modules->bitOffsetOrWidth;
+
+    // Rows: runs, finder-like patterns, 2*2 blocks and dark modules
+    for (y = 0; y < size; y++) {
+        prev = bothPrev = nonePrev = 0;
+        for (w = 0, pos = 0; pos < size; w++, pos += 32) {
+            cur = mask_getModulesWord(modules, isFunction, mask, pos, y) & \
+                  pn_getValidBits(pos, 0, size);
+            result += pn_scoreLineWord(cur, prev, pos, size);
+            black += pn_popCount(cur);
+
+            // 2*2 blocks of modules having same color
+            if (y > 0) {
+                both = cur & above[w];
+                none = ~(cur | above[w]);
+                blocks = (both & ((both >> 1) | (bothPrev << 31))) | \
+                         (none & ((none >> 1) | (nonePrev << 31)));
+                result += PENALTY_N2 * \
+                    pn_popCount(blocks & pn_getValidBits(pos, 1, size));
+                bothPrev = both;
+                nonePrev = none;
             }
 
-            // Balance of black and white modules
-            if (color) black++;
+            above[w] = cur;
+            prev = cur;
         }
+        if (result > limit) return result;
     }
 
     // Find smallest k such that (45-5k)% <= dark/total <= (55+5k)%
@@ -594,11 +1228,155 @@ static rt_uint32_t getPenaltyScore(BitBucket *modules) {
         result += PENALTY_N4;
     }
 
+    // Columns: runs and finder-like patterns, 32 columns at a time
+    for (x = 0; x < size; x += 32) {
+        rt_memset(tilePrev, 0x00, sizeof(tilePrev));
+        for (pos = 0; pos < size; pos += 32) {
+            for (i = 0; i < 32; i++) {
+                tile[i] = (pos + i < size) ? mask_getModulesWord(modules,
+                    isFunction, mask, x, pos + i) : 0;
+            }
+            bb_transpose(tile);
+            for (i = 0; (i < 32) && (x + i < size); i++) {
+                result += pn_scoreLineWord(tile[i], tilePrev[i], pos, size);
+                tilePrev[i] = tile[i];
+            }
+            if (result > limit) return result;
+        }
+    }
+
     return result;
 }
 
-static rt_uint8_t rs_multiply(rt_uint8_t x, rt_uint8_t y) {
-    rt_uint16_t z;
+/* Estimates the penalty score of a mask from the runs and finder-like
+   patterns in every 4th row, to find a good mask early.
+ */
+static rt_uint32_t getPenaltyEstimate(BitBucket *modules,
+    FunctionMap *isFunction, rt_uint8_t mask) {
+    rt_uint32_t result, cur, prev;
+    rt_uint16_t pos;
+    rt_uint8_t size, y;
+
+    result = 0;
+    size = modules->bitOffsetOrWidth;
+    for (y = 0; y < size; y += 4) {
+        for (prev = 0, pos = 0; pos < size; pos += 32) {
+            cur = mask_getModulesWord(modules, isFunction, mask, pos, y) & \
+                  pn_getValidBits(pos, 0, size);
+            result += pn_scoreLineWord(cur, prev, pos, size);
+            prev = cur;
+        }
+    }
+    return result;
+}
+
+/* Returns the mask with the lowest penalty score (the lowest numbered one
+   among equals), with its format bits drawn.
+   Masks are scored in the order of their estimates, and each score is given
+   up as soon as it can no longer beat the best one so far. With
+   "estimateOnly" the best estimate is taken as is.
+ */
+static rt_uint8_t getBestMask(BitBucket *modules, FunctionMap *isFunction,
+    rt_uint8_t ecc, rt_bool_t estimateOnly) {
+    rt_uint32_t estimate[8], penalty, minPenalty, limit;
+    rt_uint8_t order[8], mask, i, j;
+
+    // Insertion sort, equal estimates stay in mask order
+    for (i = 0; i < 8; i++) {
+        drawFormatBits(modules, isFunction, ecc, i);
+        estimate[i] = getPenaltyEstimate(modules, isFunction, i);
+        for (j = i; (j > 0) && (estimate[order[j - 1]] > estimate[i]); j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+    if (estimateOnly) {
+        drawFormatBits(modules, isFunction, ecc, order[0]);
+        return order[0];
+    }
+
+    mask = 0;
+    minPenalty = 0xFFFFFFFF;
+    for (i = 0; i < 8; i++) {
+        // A lower numbered mask also wins with an equal score
+        limit = (order[i] < mask) ? minPenalty : minPenalty - 1;
+        drawFormatBits(modules, isFunction, ecc, order[i]);
+        penalty = getPenaltyScore(modules, isFunction, order[i], limit);
+        if (penalty <= limit) {
+            mask = order[i];
+            minPenalty = penalty;
+        }
+    }
+
+    drawFormatBits(modules, isFunction, ecc, mask);
+    return mask;
+}
+
+/* Generator polynomials for every block ECC length used by QR Code, which is
+   the product (x - r^0) * (x - r^1) * (x - r^2) * ... * (x - r^{degree-1})
+   with the highest term dropped and the rest of the coefficients stored in
+   order of descending powers. r = 0x02, a generator element of GF(2^8/0x11D).
+   With QR_GF_TABLES the coefficients are stored as their logarithms (none of
+   them is zero).
+ */
+static const rt_uint8_t RS_GENERATORS[246] = {
+#if QR_GF_TABLES
+    0x57, 0xe5, 0x92, 0x95, 0xee, 0x66, 0x15,  // 7
+    0xfb, 0x43, 0x2e, 0x3d, 0x76, 0x46, 0x40, 0x5e, 0x20, 0x2d,  // 10
+    0x4a, 0x98, 0xb0, 0x64, 0x56, 0x64, 0x6a, 0x68, 0x82, 0xda, 0xce, 0x8c, 0x4e,  // 13
+    0x08, 0xb7, 0x3d, 0x5b, 0xca, 0x25, 0x33, 0x3a, 0x3a, 0xed, 0x8c, 0x7c, 0x05, 0x63, 0x69,  // 15
+    0x78, 0x68, 0x6b, 0x6d, 0x66, 0xa1, 0x4c, 0x03, 0x5b, 0xbf, 0x93, 0xa9, 0xb6, 0xc2, 0xe1, 0x78,  // 16
+    0x2b, 0x8b, 0xce, 0x4e, 0x2b, 0xef, 0x7b, 0xce, 0xd6, 0x93, 0x18, 0x63, 0x96, 0x27, 0xf3, 0xa3,  // 17
+    0x88,
+    0xd7, 0xea, 0x9e, 0x5e, 0xb8, 0x61, 0x76, 0xaa, 0x4f, 0xbb, 0x98, 0x94, 0xfc, 0xb3, 0x05, 0x62,  // 18
+    0x60, 0x99,
+    0x11, 0x3c, 0x4f, 0x32, 0x3d, 0xa3, 0x1a, 0xbb, 0xca, 0xb4, 0xdd, 0xe1, 0x53, 0xef, 0x9c, 0xa4,  // 20
+    0xd4, 0xd4, 0xbc, 0xbe,
+    0xd2, 0xab, 0xf7, 0xf2, 0x5d, 0xe6, 0x0e, 0x6d, 0xdd, 0x35, 0xc8, 0x4a, 0x08, 0xac, 0x62, 0x50,  // 22
+    0xdb, 0x86, 0xa0, 0x69, 0xa5, 0xe7,
+    0xe5, 0x79, 0x87, 0x30, 0xd3, 0x75, 0xfb, 0x7e, 0x9f, 0xb4, 0xa9, 0x98, 0xc0, 0xe2, 0xe4, 0xda,  // 24
+    0x6f, 0x00, 0x75, 0xe8, 0x57, 0x60, 0xe3, 0x15,
+    0xad, 0x7d, 0x9e, 0x02, 0x67, 0xb6, 0x76, 0x11, 0x91, 0xc9, 0x6f, 0x1c, 0xa5, 0x35, 0xa1, 0x15,  // 26
+    0xf5, 0x8e, 0x0d, 0x66, 0x30, 0xe3, 0x99, 0x91, 0xda, 0x46,
+    0xa8, 0xdf, 0xc8, 0x68, 0xe0, 0xea, 0x6c, 0xb4, 0x6e, 0xbe, 0xc3, 0x93, 0xcd, 0x1b, 0xe8, 0xc9,  // 28
+    0x15, 0x2b, 0xf5, 0x57, 0x2a, 0xc3, 0xd4, 0x77, 0xf2, 0x25, 0x09, 0x7b,
+    0x29, 0xad, 0x91, 0x98, 0xd8, 0x1f, 0xb3, 0xb6, 0x32, 0x30, 0x6e, 0x56, 0xef, 0x60, 0xde, 0x7d,  // 30
+    0x2a, 0xad, 0xe2, 0xc1, 0xe0, 0x82, 0x9c, 0x25, 0xfb, 0xd8, 0xee, 0x28, 0xc0, 0xb4,
+#else
+    0x7f, 0x7a, 0x9a, 0xa4, 0x0b, 0x44, 0x75,  // 7
+    0xd8, 0xc2, 0x9f, 0x6f, 0xc7, 0x5e, 0x5f, 0x71, 0x9d, 0xc1,  // 10
+    0x89, 0x49, 0xe3, 0x11, 0xb1, 0x11, 0x34, 0x0d, 0x2e, 0x2b, 0x53, 0x84, 0x78,  // 13
+    0x1d, 0xc4, 0x6f, 0xa3, 0x70, 0x4a, 0x0a, 0x69, 0x69, 0x8b, 0x84, 0x97, 0x20, 0x86, 0x1a,  // 15
+    0x3b, 0x0d, 0x68, 0xbd, 0x44, 0xd1, 0x1e, 0x08, 0xa3, 0x41, 0x29, 0xe5, 0x62, 0x32, 0x24, 0x3b,  // 16
+    0x77, 0x42, 0x53, 0x78, 0x77, 0x16, 0xc5, 0x53, 0xf9, 0x29, 0x8f, 0x86, 0x55, 0x35, 0x7d, 0x63,  // 17
+    0x4f,
+    0xef, 0xfb, 0xb7, 0x71, 0x95, 0xaf, 0xc7, 0xd7, 0xf0, 0xdc, 0x49, 0x52, 0xad, 0x4b, 0x20, 0x43,  // 18
+    0xd9, 0x92,
+    0x98, 0xb9, 0xf0, 0x05, 0x6f, 0x63, 0x06, 0xdc, 0x70, 0x96, 0x45, 0x24, 0xbb, 0x16, 0xe4, 0xc6,  // 20
+    0x79, 0x79, 0xa5, 0xae,
+    0x59, 0xb3, 0x83, 0xb0, 0xb6, 0xf4, 0x13, 0xbd, 0x45, 0x28, 0x1c, 0x89, 0x1d, 0x7b, 0x43, 0xfd,  // 22
+    0x56, 0xda, 0xe6, 0x1a, 0x91, 0xf5,
+    0x7a, 0x76, 0xa9, 0x46, 0xb2, 0xed, 0xd8, 0x66, 0x73, 0x96, 0xe5, 0x49, 0x82, 0x48, 0x3d, 0x2b,  // 24
+    0xce, 0x01, 0xed, 0xf7, 0x7f, 0xd9, 0x90, 0x75,
+    0xf6, 0x33, 0xb7, 0x04, 0x88, 0x62, 0xc7, 0x98, 0x4d, 0x38, 0xce, 0x18, 0x91, 0x28, 0xd1, 0x75,  // 26
+    0xe9, 0x2a, 0x87, 0x44, 0x46, 0x90, 0x92, 0x4d, 0x2b, 0x5e,
+    0xfc, 0x09, 0x1c, 0x0d, 0x12, 0xfb, 0xd0, 0x96, 0x67, 0xae, 0x64, 0x29, 0xa7, 0x0c, 0xf7, 0x38,  // 28
+    0x75, 0x77, 0xe9, 0x7f, 0xb5, 0x64, 0x79, 0x93, 0xb0, 0x4a, 0x3a, 0xc5,
+    0xd4, 0xf6, 0x4d, 0x49, 0xc3, 0xc0, 0x4b, 0x62, 0x05, 0x46, 0x67, 0xb1, 0x16, 0xd9, 0x8a, 0x33,  // 30
+    0xb5, 0xf6, 0x48, 0x19, 0x12, 0x2e, 0xe4, 0x4a, 0xd8, 0xc3, 0x0b, 0x6a, 0x82, 0x96,
+#endif
+};
+// Offset of each degree in RS_GENERATORS (0xFF for unused degrees)
+static const rt_uint8_t RS_GENERATOR_OFFSET[31] = {
+    //  0,    1,    2,    3,    4,    5,    6,    7,    8,    9,   10,   11,   12,   13,   14,   15
+     0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,    0, 0xff, 0xff,    7, 0xff, 0xff,   17, 0xff,   30,
+    //  16,  17,   18,   19,   20,   21,   22,   23,   24,   25,   26,   27,   28,   29,   30
+       45,   61,   78, 0xff,   96, 0xff,  116, 0xff,  138, 0xff,  162, 0xff,  188, 0xff,  216
+};
+
+#if !QR_GF_TABLES
+static rt_uint8_t rs_multiply(rt_uint8_t x, rt_uint8_t y) {
+    rt_uint16_t z;
     rt_int8_t i;
 
     // Russian peasant multiplication
@@ -609,65 +1387,55 @@ static rt_uint8_t rs_multiply(rt_uint8_t x, rt_uint8_t y) {
     }
     return z;
 }
+#endif
 
-static void rs_init(rt_uint8_t degree, rt_uint8_t *coeff) {
-    rt_uint16_t root;
-    rt_uint8_t i, j;
-
-    rt_memset(coeff, 0, degree);
-    coeff[degree - 1] = 1;
-    
-    /* Compute the product polynomial
-       (x - r^0) * (x - r^1) * (x - r^2) * ... * (x - r^{degree-1}),
-       drop the highest term, and store the rest of the coefficients in order
-       of descending powers.
-       Note that r = 0x02, which is a generator element of this field
-       GF(2^8/0x11D).
-     */
-    for (root = 1, i = 0; i < degree; i++) {
-        // Multiply the current product by (x - r^i)
-        for (j = 0; j < degree; j++) {
-            coeff[j] = rs_multiply(coeff[j], root);
-            if (j + 1 < degree) {
-                coeff[j] ^= coeff[j + 1];
-            }
-        }
-        // Multiply by 0x02 mod GF(2^8/0x11D)
-        root = (root << 1) ^ ((root >> 7) * 0x11D);
-    }
+static const rt_uint8_t *rs_getGenerator(rt_uint8_t degree) {
+    return &RS_GENERATORS[RS_GENERATOR_OFFSET[degree]];
 }
 
-static void rs_getRemainder(rt_uint8_t degree, rt_uint8_t *coeff,
+static void rs_getRemainder(rt_uint8_t degree, const rt_uint8_t *coeff,
     rt_uint8_t *data, rt_uint8_t length, rt_uint8_t *result,
     rt_uint8_t stride) {
     /* Compute the remainder by performing polynomial division */
     rt_uint8_t i, j, factor;
+#if QR_GF_TABLES
+    rt_uint16_t z, logFactor;
+#endif
 
     //for (rt_uint8_t i = 0; i < degree; i++) { result[] = 0; }
     //rt_memset(result, 0, degree);
 
+    // Without "data" it is "length" zeros
     for (i = 0; i < length; i++) {
-        factor = data[i] ^ result[0];
+        factor = (data ? data[i] : 0) ^ result[0];
         for (j = 1; j < degree; j++) {
             result[(j - 1) * stride] = result[j * stride];
         }
         result[(degree - 1) * stride] = 0;
+    #if QR_GF_TABLES
+        // coeff[] holds logarithms, see RS_GENERATORS
+        if (!factor) continue;
+        logFactor = GF_LOG[factor];
+        for (j = 0; j < degree; j++) {
+            z = coeff[j] + logFactor;
+            if (z >= 255) z -= 255;
+            result[j * stride] ^= GF_EXP[z];
+        }
+    #else
         for (j = 0; j < degree; j++) {
             result[j * stride] ^= rs_multiply(coeff[j], factor);
         }
+    #endif
     }
 }
 
-static rt_int8_t encodeDataCodewords(BitBucket *dataCodewords,
-    const rt_uint8_t *text, rt_uint16_t length, rt_uint8_t version) {
-    rt_int8_t mode;
+static void encodeDataCodewords(BitBucket *dataCodewords,
+    const rt_uint8_t *text, rt_uint16_t length, rt_uint8_t version,
+    rt_uint8_t mode) {
     rt_uint16_t accumData, i;
     rt_uint8_t accumCount;
 
-    mode = MODE_BYTE;
-
-    if (isNumeric((char*)text, length)) {
-        mode = MODE_NUMERIC;
+    if (MODE_NUMERIC == mode) {
         bb_appendBits(dataCodewords, 1 << MODE_NUMERIC, 4);
         bb_appendBits(dataCodewords, length,
             getModeBits(version, MODE_NUMERIC));
@@ -689,8 +1457,7 @@ static rt_int8_t encodeDataCodewords(BitBucket *dataCodewords,
             bb_appendBits(dataCodewords, accumData, accumCount * 3 + 1);
         }
 
-    } else if (isAlphanumeric((char*)text, length)) {
-        mode = MODE_ALPHANUMERIC;
+    } else if (MODE_ALPHANUMERIC == mode) {
         bb_appendBits(dataCodewords, 1 << MODE_ALPHANUMERIC, 4);
         bb_appendBits(dataCodewords, length,
             getModeBits(version, MODE_ALPHANUMERIC));
@@ -698,7 +1465,7 @@ static rt_int8_t encodeDataCodewords(BitBucket *dataCodewords,
         accumData = 0;
         accumCount = 0;
         for (i = 0; i  < length; i++) {
-            accumData = accumData * 45 + getAlphanumeric((char)(text[i]));
+            accumData = accumData * 45 + CHAR_VALUES[text[i]];
             accumCount++;
             if (accumCount == 2) {
                 bb_appendBits(dataCodewords, accumData, 11);
@@ -715,18 +1482,34 @@ static rt_int8_t encodeDataCodewords(BitBucket *dataCodewords,
     } else {
         bb_appendBits(dataCodewords, 1 << MODE_BYTE, 4);
         bb_appendBits(dataCodewords, length, getModeBits(version, MODE_BYTE));
-
-        for (i = 0; i < length; i++) {
-            bb_appendBits(dataCodewords, (char)(text[i]), 8);
-        }
+        bb_appendBytes(dataCodewords, text, length);
     }
+}
 
-    // bb_setBits(dataCodewords, length, 4, getModeBits(version, mode));
-    return mode;
+// Adds the terminator, then pads up to a byte and to "capacity" bytes
+static void bb_appendPadding(BitBucket *dataCodewords, rt_uint16_t capacity) {
+    rt_uint32_t padding;
+    rt_uint8_t padByte;
+
+    padding = (capacity * 8) - dataCodewords->bitOffsetOrWidth;
+    if (padding > 4) { padding = 4; }
+    bb_appendBits(dataCodewords, 0, padding);
+    bb_appendBits(dataCodewords, 0,
+        (8 - dataCodewords->bitOffsetOrWidth % 8) % 8);
+
+    // Pad with alternate bytes until data capacity is reached
+    for (padByte = 0xEC;
+         dataCodewords->bitOffsetOrWidth < (capacity * 8);
+         padByte ^= 0xEC ^ 0x11) {
+        bb_appendBits(dataCodewords, padByte, 8);
+    }
 }
 
-static void performErrorCorrection(rt_uint8_t version, rt_uint8_t ecc,
-    BitBucket *data) {
+/* Sets up "reader" to read the codewords of "data" in the interleaved order,
+   and returns the number of ECC codewords of each block
+ */
+static rt_uint8_t cw_init(CodewordReader *reader, rt_uint8_t version,
+    rt_uint8_t ecc, const rt_uint8_t *data) {
     /* See: http://www.thonky.com/qr-code-tutorial/structure-final-message */
     #if (LOCK_VERSION == 0)
         rt_uint8_t numBlocks = NUM_ERROR_CORRECTION_BLOCKS[ecc][version - 1];
@@ -739,183 +1522,625 @@ static void performErrorCorrection(rt_uint8_t version, rt_uint8_t ecc,
     #endif
 
     rt_uint8_t blockEccLen = totalEcc / numBlocks;
-    rt_uint8_t numShortBlocks = numBlocks - moduleCount / 8 % numBlocks;
     rt_uint8_t shortBlockLen = moduleCount / 8 / numBlocks;
-    rt_uint8_t shortDataBlockLen = shortBlockLen - blockEccLen;
 
-    rt_uint8_t *result, *coeff, *dataBytes;
-    rt_uint16_t offset;
-    rt_uint8_t i, blockNum, blockSize;
+    #if (LOCK_VERSION != 0)
+        (void)version;
+    #endif
+    reader->data = data;
+    reader->index = 0;
+    reader->dataCount = moduleCount / 8 - totalEcc;
+    reader->blockStart = 0;
+    reader->block = 0;
+    reader->column = 0;
+    reader->numBlocks = numBlocks;
+    reader->numShortBlocks = numBlocks - moduleCount / 8 % numBlocks;
+    reader->shortDataBlockLen = shortBlockLen - blockEccLen;
+    return blockEccLen;
+}
 
-    result = (rt_uint8_t *)rt_calloc(1, data->capacityBytes);
-    coeff = (rt_uint8_t *)rt_calloc(1, blockEccLen);
-    if (!result || !coeff) {
-        LOG_W("No Memory");
-        rt_free(result);
-        rt_free(coeff);
-        return;
-    }
-    rs_init(blockEccLen, coeff);
+/* Appends the ECC codewords after the data ones, already interleaved, and sets
+   up "reader" to read them all in the interleaved order. The data codewords
+   stay block after block, so no copy of them is needed.
+ */
+static void performErrorCorrection(rt_uint8_t version, rt_uint8_t ecc,
+    BitBucket *data, CodewordReader *reader) {
+    const rt_uint8_t *coeff;
+    rt_uint8_t *dataBytes;
+    rt_uint8_t blockEccLen, blockNum, blockSize;
 
-    offset = 0;
+    blockEccLen = cw_init(reader, version, ecc, data->data);
+    coeff = rs_getGenerator(blockEccLen);
     dataBytes = data->data;
 
-    // Interleave all short blocks
-    for (i = 0; i < shortDataBlockLen; i++) {
-        rt_uint8_t blockNum;
-        rt_uint16_t index = i;
-        rt_uint8_t stride = shortDataBlockLen;
-        for (blockNum = 0; blockNum < numBlocks; blockNum++) {
-            result[offset++] = dataBytes[index];
+    // The ECC area is still zeroed from bb_initBuffer()
+    blockSize = reader->shortDataBlockLen;
+    for (blockNum = 0; blockNum < reader->numBlocks; blockNum++) {
         #if (LOCK_VERSION == 0) || (LOCK_VERSION >= 5)
-            if (blockNum == numShortBlocks) stride++;
+            if (blockNum == reader->numShortBlocks) blockSize++;
         #endif
-            index += stride;
+        rs_getRemainder(blockEccLen, coeff, dataBytes, blockSize,
+            &data->data[reader->dataCount + blockNum], reader->numBlocks);
+        dataBytes += blockSize;
+    }
+}
+
+/* We store the Format bits tightly packed into a single byte (each of the 4
+   modes is 2 bits)
+   The format bits can be determined by ECC_FORMAT_BITS >> (2 * ecc)
+ */
+static const rt_uint8_t ECC_FORMAT_BITS = \
+    (0x02 << 6) | (0x03 << 4) | (0x00 << 2) | (0x01 << 0);
+
+#if CLASSIFY_VECTOR
+/* 16 characters at a time: sets the lanes that are not digits in "notNumeric"
+   and the ones not alphanumeric in "notAlphanumeric"
+ */
+typedef rt_uint8_t ClassVector __attribute__((vector_size(16)));
+
+static void cl_classify16(const rt_uint8_t *text, ClassVector *notNumeric,
+    ClassVector *notAlphanumeric) {
+    ClassVector v, digit, alphanumeric;
+
+    __builtin_memcpy(&v, text, sizeof(v));  // Unaligned load
+    digit = (ClassVector)((v - (rt_uint8_t)'0') < 10);
+    alphanumeric = digit | (ClassVector)((v - (rt_uint8_t)'A') < 26) | \
+        (ClassVector)(v == ' ') | (ClassVector)(v == '$') | \
+        (ClassVector)(v == '%') | (ClassVector)(v == '*') | \
+        (ClassVector)(v == '+') | (ClassVector)(v == '-') | \
+        (ClassVector)(v == '.') | (ClassVector)(v == '/') | \
+        (ClassVector)(v == ':');
+    *notNumeric |= ~digit;
+    *notAlphanumeric |= ~alphanumeric;
+}
+
+static rt_bool_t cl_isSet(ClassVector v) {
+    rt_uint32_t words[4];
+
+    __builtin_memcpy(words, &v, sizeof(words));
+    return (words[0] | words[1] | words[2] | words[3]) != 0;
+}
+#endif /* CLASSIFY_VECTOR */
+
+// The tightest single mode, in one pass
+static rt_uint8_t getMode(const rt_uint8_t *text, rt_uint16_t length) {
+    rt_uint8_t mode, value;
+    rt_uint16_t i;
+
+    mode = MODE_NUMERIC;
+    i = 0;
+    #if CLASSIFY_VECTOR
+        if (length >= CLASSIFY_VECTOR_MIN) {
+            ClassVector notNumeric = { 0 }, notAlphanumeric = { 0 };
+
+            for ( ; i + 16 <= length; i += 16) {
+                cl_classify16(&text[i], &notNumeric, &notAlphanumeric);
+                // Check for bytes every 256 characters
+                if (!(i & 0xf0) && cl_isSet(notAlphanumeric)) return MODE_BYTE;
+            }
+            if (cl_isSet(notAlphanumeric)) return MODE_BYTE;
+            if (cl_isSet(notNumeric)) mode = MODE_ALPHANUMERIC;
         }
+    #endif
+
+    for ( ; i < length; i++) {
+        value = CHAR_VALUES[text[i]];
+        if (CHAR_BYTE_ONLY == value) return MODE_BYTE;
+        if (value >= 10) mode = MODE_ALPHANUMERIC;
+    }
+    return mode;
+}
+
+// Bits taken by "length" characters in "mode", the segment header included
+static rt_uint32_t getSegmentBits(rt_uint8_t version, rt_uint8_t mode,
+    rt_uint16_t length) {
+    rt_uint32_t result;
+
+    result = 4 + getModeBits(version, mode);
+    if (MODE_NUMERIC == mode) {
+        result += length / 3 * 10;
+        if (length % 3) result += length % 3 * 3 + 1;
+    } else if (MODE_ALPHANUMERIC == mode) {
+        result += length / 2 * 11 + length % 2 * 6;
+    } else {
+        result += (rt_uint32_t)length * 8;
+    }
+    return result;
+}
+
+/* Mixed mode segmentation
+
+   The plan is a dynamic program over the data, from its end: for each
+   character and each mode it may take, the cheapest encoding of the rest
+   given that the character is in that mode, either continuing its segment or
+   opening a new one (header included) for the next character. Costs are in
+   1/6 bits, so a numeric character costs 20 (3 digits in 10 bits), an
+   alphanumeric one 33 (2 characters in 11 bits) and a byte 48.
+
+   Per character, the mode of the next one is kept for each of the 3 modes of
+   this one (6 bits, packed). Walking the plan from the cheapest first mode
+   then gives the segments in order. The plan may be split over two buffers,
+   the first one holding "split" characters.
+ */
+#define SEG_COST_INFINITE           0xFFFFFFFF
+
+static const rt_uint8_t SEG_CHAR_COST[3] = { 20, 33, 48 };
+
+typedef struct SegPlan {
+    rt_uint8_t *regions[2];
+    rt_uint16_t split;
+} SegPlan;
+
+static rt_uint16_t seg_getPlanSize(rt_uint16_t length) {
+    // One spare byte for the 16-bit accesses
+    return (6 * (rt_uint32_t)length + 7) / 8 + 1;
+}
+
+// Characters a buffer of "bytes" holds, the inverse of seg_getPlanSize()
+static rt_uint16_t seg_getEntries(rt_uint16_t bytes) {
+    return bytes ? 8 * (rt_uint32_t)(bytes - 1) / 6 : 0;
+}
+
+static void seg_setChoices(SegPlan *plan, rt_uint16_t index,
+    rt_uint8_t choices) {
+    rt_uint8_t *region = plan->regions[index >= plan->split];
+    rt_uint32_t offset, bits;
+
+    if (index >= plan->split) index -= plan->split;
+    offset = 6 * (rt_uint32_t)index;
+    bits = (rt_uint32_t)choices << (10 - (offset & 0x07));
+    region[offset >> 3] |= bits >> 8;
+    region[(offset >> 3) + 1] |= bits & 0xff;
+}
+
+static rt_uint8_t seg_getChoices(const SegPlan *plan, rt_uint16_t index) {
+    const rt_uint8_t *region = plan->regions[index >= plan->split];
+    rt_uint32_t offset;
+
+    if (index >= plan->split) index -= plan->split;
+    offset = 6 * (rt_uint32_t)index;
+    return (((region[offset >> 3] << 8) | region[(offset >> 3) + 1]) >> \
+        (10 - (offset & 0x07))) & 0x3f;
+}
+
+// Bitmap of the modes able to hold the character
+static rt_uint8_t seg_getModes(rt_uint8_t c) {
+    rt_uint8_t value = CHAR_VALUES[c];
+
+    if (value < 10) {
+        return (1 << MODE_NUMERIC) | (1 << MODE_ALPHANUMERIC) | \
+            (1 << MODE_BYTE);
+    }
+    if (CHAR_BYTE_ONLY != value) {
+        return (1 << MODE_ALPHANUMERIC) | (1 << MODE_BYTE);
     }
+    return 1 << MODE_BYTE;
+}
 
-    // Version less than 5 only have short blocks
-    #if (LOCK_VERSION == 0) || (LOCK_VERSION >= 5)
-    {
-        // Interleave long blocks
-        rt_uint16_t index = shortDataBlockLen * (numShortBlocks + 1);
-        rt_uint8_t stride = shortDataBlockLen;
-        for (blockNum = 0; blockNum < numBlocks - numShortBlocks; blockNum++) {
-            result[offset++] = dataBytes[index];
-            if (blockNum == 0) stride++;
-            index += stride;
+/* Returns the planned bits, rounded up from 1/6 bits; as each segment rounds
+   up on its own the exact count may be a few bits more (see seg_walk()).
+   Without "plan" only the cost is computed.
+ */
+static rt_uint32_t seg_plan(const rt_uint8_t *text, rt_uint16_t length,
+    rt_uint8_t version, SegPlan *plan, rt_uint8_t *firstMode) {
+    rt_uint32_t cost[3], next[3], header[3], best;
+    rt_uint16_t i;
+    rt_uint8_t modes, mode, other, choice, choices;
+
+    if (plan) {
+        if (length <= plan->split) {
+            rt_memset(plan->regions[0], 0x00, seg_getPlanSize(length));
+        } else {
+            rt_memset(plan->regions[0], 0x00, seg_getPlanSize(plan->split));
+            rt_memset(plan->regions[1], 0x00,
+                seg_getPlanSize(length - plan->split));
         }
     }
-    #endif
+    for (mode = 0; mode < 3; mode++) {
+        header[mode] = (4 + getModeBits(version, mode)) * 6;
+        cost[mode] = 0;
+    }
 
-    // Add all ecc blocks, interleaved
-    blockSize = shortDataBlockLen;
-    for (blockNum = 0; blockNum < numBlocks; blockNum++) {
-        #if (LOCK_VERSION == 0) || (LOCK_VERSION >= 5)
-            if (blockNum == numShortBlocks) blockSize++;
-        #endif
-        rs_getRemainder(blockEccLen, coeff, dataBytes, blockSize,
-            &result[offset + blockNum], numBlocks);
-        dataBytes += blockSize;
+    for (i = length; i > 0; i--) {
+        modes = seg_getModes(text[i - 1]);
+        choices = 0;
+        for (mode = 0; mode < 3; mode++) {
+            if (!(modes & (1 << mode))) {
+                next[mode] = SEG_COST_INFINITE;
+                continue;
+            }
+            best = cost[mode];
+            choice = mode;
+            for (other = 0; other < 3; other++) {
+                if ((other == mode) || (SEG_COST_INFINITE == cost[other]))
+                    continue;
+                if (header[other] + cost[other] < best) {
+                    best = header[other] + cost[other];
+                    choice = other;
+                }
+            }
+            next[mode] = best + SEG_CHAR_COST[mode];
+            choices |= choice << (2 * mode);
+        }
+        if (plan) seg_setChoices(plan, i - 1, choices);
+        rt_memcpy(cost, next, sizeof(cost));
     }
 
-    rt_memcpy(data->data, result, data->capacityBytes);
-    data->bitOffsetOrWidth = moduleCount;
+    best = SEG_COST_INFINITE;
+    for (mode = 0; mode < 3; mode++) {
+        if (SEG_COST_INFINITE == cost[mode]) continue;
+        if (header[mode] + cost[mode] < best) {
+            best = header[mode] + cost[mode];
+            *firstMode = mode;
+        }
+    }
+    return (best + 5) / 6;
+}
+
+/* Walks the plan and returns the exact bits of its segments. With
+   "codewords" the segments are also appended to it. "mode" gets the mode of
+   the only segment, or MODE_MIXED.
+ */
+static rt_uint32_t seg_walk(BitBucket *codewords, const rt_uint8_t *text,
+    rt_uint16_t length, rt_uint8_t version, const SegPlan *plan,
+    rt_uint8_t firstMode, rt_uint8_t *mode) {
+    rt_uint32_t result;
+    rt_uint16_t i, start;
+    rt_uint8_t current, next;
+
+    *mode = firstMode;
+    if (!length) {
+        if (codewords)
+            encodeDataCodewords(codewords, text, 0, version, firstMode);
+        return getSegmentBits(version, firstMode, 0);
+    }
 
-    rt_free(result);
-    rt_free(coeff);
+    result = 0;
+    current = firstMode;
+    for (i = 0, start = 0; i < length; i++) {
+        next = (i + 1 < length) ? \
+            (seg_getChoices(plan, i) >> (2 * current)) & 0x03 : 0xff;
+        if (next == current) continue;
+
+        result += getSegmentBits(version, current, i + 1 - start);
+        if (codewords) {
+            encodeDataCodewords(codewords, &text[start], i + 1 - start,
+                version, current);
+        }
+        if (start) *mode = MODE_MIXED;
+        start = i + 1;
+        current = next;
+    }
+    return result;
 }
 
-/* We store the Format bits tightly packed into a single byte (each of the 4
-   modes is 2 bits)
-   The format bits can be determined by ECC_FORMAT_BITS >> (2 * ecc)
+// Bits of the data in "mode", or the estimate of its plan with MODE_MIXED
+static rt_uint32_t getDataBits(rt_uint8_t version, const rt_uint8_t *text,
+    rt_uint16_t length, rt_uint8_t mode) {
+    rt_uint8_t firstMode;
+
+    if (MODE_MIXED == mode)
+        return seg_plan(text, length, version, RT_NULL, &firstMode);
+    return getSegmentBits(version, mode, length);
+}
+
+static rt_uint32_t getDataCapacityBits(rt_uint8_t version,
+    rt_uint8_t eccFormatBits) {
+    #if (LOCK_VERSION == 0)
+        return (NUM_RAW_DATA_MODULES[version - 1] / 8 - \
+            NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits][version - 1]) * 8;
+    #else
+        (void)version;
+        return (NUM_RAW_DATA_MODULES / 8 - \
+            NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits]) * 8;
+    #endif
+}
+
+#if (LOCK_VERSION == 0)
+/* Binary search of the smallest version in [from, to] holding the data, or 0.
+   The capacity grows much faster with the version than the count fields do,
+   so whether the data fits is monotonic in the version.
  */
-static const rt_uint8_t ECC_FORMAT_BITS = \
-    (0x02 << 6) | (0x03 << 4) | (0x00 << 2) | (0x01 << 0);
+static rt_uint8_t getMinVersion(rt_uint8_t from, rt_uint8_t to,
+    rt_uint8_t eccFormatBits, const rt_uint8_t *text, rt_uint16_t length,
+    rt_uint8_t mode) {
+    rt_uint8_t mid;
+
+    if (getDataBits(to, text, length, mode) > \
+        getDataCapacityBits(to, eccFormatBits)) {
+        return 0;
+    }
+    while (from < to) {
+        mid = (from + to) / 2;
+        if (getDataBits(mid, text, length, mode) > \
+            getDataCapacityBits(mid, eccFormatBits)) {
+            from = mid + 1;
+        } else {
+            to = mid;
+        }
+    }
+    return from;
+}
+#endif
+
+rt_uint16_t qrcode_getCapacity(rt_uint8_t version, rt_uint8_t ecc,
+    rt_uint8_t mode) {
+    rt_uint8_t eccFormatBits;
+    rt_uint32_t bits;
+
+    #if (LOCK_VERSION != 0)
+        version = LOCK_VERSION;
+    #endif
+    // 0 for QR_VERSION_AUTO, MODE_MIXED and anything out of range
+    if ((version < 1) || (version > 40) || (ecc > ECC_HIGH) || \
+        (mode > MODE_BYTE)) {
+        return 0;
+    }
+    eccFormatBits = (ECC_FORMAT_BITS >> (2 * ecc)) & 0x03;
+    bits = getDataCapacityBits(version, eccFormatBits) - 4 - \
+        getModeBits(version, mode);
+    if (MODE_NUMERIC == mode) {
+        return bits / 10 * 3 + \
+            ((bits % 10 >= 7) ? 2 : (bits % 10 >= 4) ? 1 : 0);
+    } else if (MODE_ALPHANUMERIC == mode) {
+        return bits / 11 * 2 + ((bits % 11 >= 6) ? 1 : 0);
+    }
+    return bits / 8;
+}
 
 rt_uint16_t qrcode_getBufferSize(rt_uint8_t version) {
     return bb_getGridSizeBytes(4 * version + 17);
 }
 
-// @TODO: Return error if data is too big.
-rt_int8_t qrcode_initBytes(QRCode *qrcode, rt_uint8_t *modules,
-    rt_uint8_t version, rt_uint8_t ecc, rt_uint8_t *data, rt_uint16_t length) {
-    rt_uint8_t size = version * 4 + 17;
-    rt_uint8_t eccFormatBits = (ECC_FORMAT_BITS >> (2 * ecc)) & 0x03;
+#if QR_LOW_MEMORY
+/* Bytes of the segment plan of the longest data of a version which do not
+   fit in the modules grid
+ */
+static rt_uint16_t seg_getExtraSize(rt_uint8_t version) {
+    rt_uint16_t length, entries;
+
+    length = qrcode_getCapacity(version, ECC_LOW, MODE_NUMERIC);
+    entries = seg_getEntries(bb_getGridSizeBytes(4 * version + 17));
+    return (length > entries) ? seg_getPlanSize(length - entries) : 0;
+}
+#endif
 
+/* The workspace holds the codewords and the function module grid; the
+   interleaving is done while placing the codewords. With QR_LOW_MEMORY the
+   grid is replaced by the rest of the segment plan, only used in mixed mode:
+   any other encode needs the codewords only.
+ */
+static rt_uint16_t getWorkspaceSize(rt_uint8_t version, rt_bool_t mixedMode) {
     #if (LOCK_VERSION == 0)
         rt_uint16_t moduleCount = NUM_RAW_DATA_MODULES[version - 1];
-        rt_uint16_t dataCapacity = moduleCount / 8 - \
-            NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits][version - 1];
     #else
-        version = LOCK_VERSION;
         rt_uint16_t moduleCount = NUM_RAW_DATA_MODULES;
-        rt_uint16_t dataCapacity = moduleCount / 8 - \
-            NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits];
+        version = LOCK_VERSION;
     #endif
 
-    struct BitBucket codewords;
-    rt_uint8_t *codewordBytes;
-    rt_int8_t mode;
-    rt_uint32_t padding;
-    rt_uint8_t padByte;
-    BitBucket modulesGrid, isFunctionGrid;
-    rt_uint8_t *isFunctionGridBytes;
-    rt_uint8_t mask, i;
-    rt_int32_t minPenalty;
+    #if QR_LOW_MEMORY
+        return bb_getBufferSizeBytes(moduleCount) + \
+            (mixedMode ? seg_getExtraSize(version) : 0);
+    #else
+        (void)mixedMode;
+        return bb_getBufferSizeBytes(moduleCount) + \
+            bb_getGridSizeBytes(4 * version + 17);
+    #endif
+}
 
-    qrcode->version = version;
-    qrcode->size = size;
-    qrcode->ecc = ecc;
-    qrcode->modules = modules;
+// Bytes of any workspace of "version", in mixed mode or not
+rt_uint16_t qrcode_getWorkspaceSize(rt_uint8_t version) {
+    return getWorkspaceSize(version, RT_TRUE);
+}
 
-    codewordBytes = (rt_uint8_t *)rt_calloc(1,
-        bb_getBufferSizeBytes(moduleCount));
-    if (!codewordBytes) {
-        LOG_W("No Memory");
-        return -RT_ENOMEM;
+// Bytes of the workspace of the encodes of "options" at "version"
+rt_uint16_t qrcode_getWorkspaceSizeEx(rt_uint8_t version,
+    const QRCodeOptions *options) {
+    return getWorkspaceSize(version, options->mixedMode);
+}
+
+void qrcode_initOptions(QRCodeOptions *options) {
+    options->mask = QR_MASK_AUTO;
+    options->workspace = RT_NULL;
+    options->minVersion = 1;
+    options->maxVersion = 40;
+    options->mixedMode = RT_FALSE;
+}
+
+rt_int8_t qrcode_initBytesEx(QRCode *qrcode, rt_uint8_t *modules,
+    rt_uint8_t version, rt_uint8_t ecc, rt_uint8_t *data, rt_uint16_t length,
+    const QRCodeOptions *options) {
+    rt_uint8_t eccFormatBits;
+    rt_uint8_t size;
+    rt_uint16_t moduleCount, dataCapacity;
+    struct BitBucket codewords;
+    CodewordReader reader;
+    SegPlan plan;
+    rt_uint8_t *workspace, *codewordBytes;
+    rt_uint16_t codewordSize, planEntries;
+    rt_uint8_t mode, firstMode, maxVersion;
+    BitBucket modulesGrid;
+    FunctionMap isFunctionGrid;
+    #if !QR_LOW_MEMORY
+        rt_uint8_t *isFunctionGridBytes;
+    #endif
+    rt_uint8_t mask;
+    QRCodeOptions defaults;
+    #if QR_TEMPLATE_CACHE
+        TemplateEntry *template;
+    #endif
+
+    if (!options) {
+        qrcode_initOptions(&defaults);
+        options = &defaults;
+    }
+    if ((ecc > ECC_HIGH) || (options->mask < QR_MASK_FAST) || \
+        (options->mask > 7)) {
+        return -RT_EINVAL;
     }
-    bb_initBuffer(&codewords, codewordBytes,
-        (rt_int32_t)bb_getBufferSizeBytes(moduleCount));
+    eccFormatBits = (ECC_FORMAT_BITS >> (2 * ecc)) & 0x03;
 
-    // Place the data code words into the buffer
-    mode = encodeDataCodewords(&codewords, data, length, version);
-    if (mode < 0) return -1;
-    qrcode->mode = mode;
+    mode = options->mixedMode ? MODE_MIXED : getMode(data, length);
+    #if (LOCK_VERSION == 0)
+        if (QR_VERSION_AUTO == version) {
+            if ((options->minVersion < 1) || \
+                (options->minVersion > options->maxVersion) || \
+                (options->maxVersion > 40)) {
+                return -RT_EINVAL;
+            }
+            maxVersion = options->maxVersion;
+            version = getMinVersion(options->minVersion, maxVersion,
+                eccFormatBits, data, length, mode);
+        } else {
+            if (version > 40) return -RT_EINVAL;
+            maxVersion = version;
+            if (getDataBits(version, data, length, mode) > \
+                getDataCapacityBits(version, eccFormatBits)) {
+                version = 0;
+            }
+        }
+    #else
+        version = LOCK_VERSION;
+        maxVersion = version;
+        if (getDataBits(version, data, length, mode) > \
+            getDataCapacityBits(version, eccFormatBits)) {
+            version = 0;
+        }
+    #endif
+    if (!version) return -RT_EFULL;
 
-    // Add terminator and pad up to a byte if applicable
-    padding = (dataCapacity * 8) - codewords.bitOffsetOrWidth;
-    if (padding > 4) { padding = 4; }
-    bb_appendBits(&codewords, 0, padding);
-    bb_appendBits(&codewords, 0, (8 - codewords.bitOffsetOrWidth % 8) % 8);
+    /* The segment plan is only known to fit once it is laid out, which may
+       take the next version.
+     */
+    for ( ; ; ) {
+        #if (LOCK_VERSION == 0)
+            moduleCount = NUM_RAW_DATA_MODULES[version - 1];
+        #else
+            moduleCount = NUM_RAW_DATA_MODULES;
+        #endif
+        size = version * 4 + 17;
+        dataCapacity = getDataCapacityBits(version, eccFormatBits) / 8;
 
-    // Pad with alternate bytes until data capacity is reached
-    for (padByte = 0xEC;
-         codewords.bitOffsetOrWidth < (dataCapacity * 8);
-         padByte ^= 0xEC ^ 0x11) {
-        bb_appendBits(&codewords, padByte, 8);
+        codewordSize = bb_getBufferSizeBytes(moduleCount);
+
+        // Carve all the scratch from one block
+        workspace = options->workspace;
+        if (!workspace) {
+            workspace = (rt_uint8_t *)rt_calloc(1,
+                qrcode_getWorkspaceSizeEx(version, options));
+            if (!workspace) {
+                LOG_W("No Memory");
+                return -RT_ENOMEM;
+            }
+        }
+        codewordBytes = workspace;
+        #if !QR_LOW_MEMORY
+            isFunctionGridBytes = codewordBytes + codewordSize;
+        #endif
+        if (MODE_MIXED != mode) break;
+
+        // The plan borrows the modules grid and the function grid
+        plan.regions[0] = modules;
+        plan.split = seg_getEntries(bb_getGridSizeBytes(size));
+        #if QR_LOW_MEMORY
+            plan.regions[1] = codewordBytes + codewordSize;
+            planEntries = plan.split + \
+                seg_getEntries(seg_getExtraSize(version));
+        #else
+            plan.regions[1] = isFunctionGridBytes;
+            planEntries = 2 * plan.split;
+        #endif
+        if (length <= planEntries) {
+            seg_plan(data, length, version, &plan, &firstMode);
+            if (seg_walk(RT_NULL, data, length, version, &plan,
+                firstMode, &qrcode->mode) <= dataCapacity * 8U) {
+                break;
+            }
+        }
+        if (!options->workspace) rt_free(workspace);
+        if (version >= maxVersion) return -RT_EFULL;
+        version++;
     }
 
-    bb_initGrid(&modulesGrid, modules, size);
+    qrcode->version = version;
+    qrcode->size = size;
+    qrcode->ecc = ecc;
+    qrcode->modules = modules;
 
-    isFunctionGridBytes = (rt_uint8_t *)rt_calloc(1, bb_getGridSizeBytes(size));
-    if (!isFunctionGridBytes) {
-        LOG_W("No Memory");
-        return -RT_ENOMEM;
+    // Place the data code words into the buffer
+    bb_initBuffer(&codewords, codewordBytes, (rt_int32_t)codewordSize);
+    if (MODE_MIXED == mode) {
+        seg_walk(&codewords, data, length, version, &plan,
+            firstMode, &qrcode->mode);
+    } else {
+        encodeDataCodewords(&codewords, data, length, version, mode);
+        qrcode->mode = mode;
     }
-    bb_initGrid(&isFunctionGrid, isFunctionGridBytes, size);
 
-    drawFunctionPatterns(&modulesGrid, &isFunctionGrid, version, eccFormatBits);
-    performErrorCorrection(version, eccFormatBits, &codewords);
-    drawCodewords(&modulesGrid, &isFunctionGrid, &codewords);
+    bb_appendPadding(&codewords, dataCapacity);
 
-    // Find the best (lowest penalty) mask
-    mask = 0;
-    minPenalty = 0x7FFFFFFF;
-    for (i = 0; i < 8; i++) {
-        drawFormatBits(&modulesGrid, &isFunctionGrid, eccFormatBits, i);
-        applyMask(&modulesGrid, &isFunctionGrid, i);
-        int penalty = getPenaltyScore(&modulesGrid);
-        if (penalty < minPenalty) {
-            mask = i;
-            minPenalty = penalty;
+    bb_initGrid(&modulesGrid, modules, size);
+    #if QR_LOW_MEMORY
+        fm_init(&isFunctionGrid, version);
+    #else
+        bb_initGrid(&isFunctionGrid, isFunctionGridBytes, size);
+    #endif
+
+    #if QR_TEMPLATE_CACHE
+        template = tpl_acquire(version);
+        if (template) {
+            tpl_load(template, &modulesGrid, &isFunctionGrid);
+        } else {
+            drawFunctionPatterns(&modulesGrid, &isFunctionGrid, version,
+                eccFormatBits);
+            template = tpl_store(&modulesGrid, &isFunctionGrid, version);
         }
-        // Undoes the mask due to XOR
-        applyMask(&modulesGrid, &isFunctionGrid, i);
-    }
+    #else
+        drawFunctionPatterns(&modulesGrid, &isFunctionGrid, version,
+            eccFormatBits);
+    #endif
+    performErrorCorrection(version, eccFormatBits, &codewords, &reader);
+    #if QR_TEMPLATE_CACHE
+        #if PLACEMENT_MAP
+            if (template) {
+                pl_place(&modulesGrid, template->runs, template->runCount,
+                    &reader, moduleCount);
+            } else {
+                drawCodewords(&modulesGrid, &isFunctionGrid, &reader,
+                    moduleCount);
+            }
+        #else
+            drawCodewords(&modulesGrid, &isFunctionGrid, &reader,
+                moduleCount);
+        #endif
+        if (template) tpl_release(template);
+    #else
+        drawCodewords(&modulesGrid, &isFunctionGrid, &reader, moduleCount);
+    #endif
 
+    if (options->mask >= 0) {
+        mask = options->mask;
+        drawFormatBits(&modulesGrid, &isFunctionGrid, eccFormatBits, mask);
+    } else {
+        // Find the best (lowest penalty) mask
+        mask = getBestMask(&modulesGrid, &isFunctionGrid, eccFormatBits,
+            QR_MASK_FAST == options->mask);
+    }
     qrcode->mask = mask;
 
-    // Overwrite old format bits
-    drawFormatBits(&modulesGrid, &isFunctionGrid, eccFormatBits, mask);
     // Apply the final choice of mask
     applyMask(&modulesGrid, &isFunctionGrid, mask);
 
-    rt_free(isFunctionGridBytes);
-    rt_free(codewordBytes);
+    if (!options->workspace) rt_free(workspace);
     return 0;
 }
 
+rt_int8_t qrcode_initBytes(QRCode *qrcode, rt_uint8_t *modules,
+    rt_uint8_t version, rt_uint8_t ecc, rt_uint8_t *data, rt_uint16_t length) {
+    return qrcode_initBytesEx(qrcode, modules, version, ecc, data, length,
+        RT_NULL);
+}
+
 rt_int8_t qrcode_initText(QRCode *qrcode, rt_uint8_t *modules,
     rt_uint8_t version, rt_uint8_t ecc, const char *data) {
     return qrcode_initBytes(qrcode, modules, version, ecc, (rt_uint8_t*)data,
@@ -932,3 +2157,1579 @@ rt_bool_t qrcode_getModule(QRCode *qrcode, rt_uint8_t x, rt_uint8_t y) {
     offset = y * qrcode->size + x;
     return (qrcode->modules[offset >> 3] & (1 << (7 - (offset & 0x07)))) != 0;
 }
+
+/* Patchable symbols
+
+   Reed-Solomon remainders are linear: when data codewords change, the ECC
+   codewords of their block change by the remainder of the difference. A patch
+   XORs in the remainder of the old codewords of the changed range then that
+   of the new ones (each followed by zeros to the end of the block), so only
+   the changed blocks are worked on from the changed codeword onwards. Then
+   only the modules of the changed codewords are drawn again, found from the
+   first data bit of each column pair of the zigzag scan.
+ */
+
+// Right column of a column pair of the zigzag scan (see drawCodewords())
+static rt_uint8_t sym_getRight(rt_uint8_t size, rt_uint8_t pair) {
+    rt_int16_t right = size - 1 - 2 * pair;
+
+    // Column 6 is skipped
+    return (right <= 6) ? right - 1 : right;
+}
+
+static void sym_getFunctionMap(QRSymbol *symbol, FunctionMap *isFunction) {
+    #if QR_LOW_MEMORY
+        fm_init(isFunction, symbol->qrcode.version);
+    #else
+        #if (LOCK_VERSION == 0)
+            rt_uint16_t moduleCount = \
+                NUM_RAW_DATA_MODULES[symbol->qrcode.version - 1];
+        #else
+            rt_uint16_t moduleCount = NUM_RAW_DATA_MODULES;
+        #endif
+
+        // The grid follows the codewords in the workspace
+        isFunction->bitOffsetOrWidth = symbol->qrcode.size;
+        isFunction->capacityBytes = bb_getGridSizeBytes(symbol->qrcode.size);
+        isFunction->data = symbol->workspace + \
+            bb_getBufferSizeBytes(moduleCount);
+    #endif
+}
+
+static rt_uint32_t sym_getBits(const rt_uint8_t *data, rt_uint32_t offset,
+    rt_uint8_t length) {
+    rt_uint32_t result = 0;
+
+    for ( ; length; length--, offset++) {
+        result = (result << 1) | ((data[offset >> 3] >> (7 - (offset & 7))) & 1);
+    }
+    return result;
+}
+
+static void sym_setBits(rt_uint8_t *data, rt_uint32_t offset,
+    rt_uint32_t val, rt_uint8_t length) {
+    rt_uint8_t mask;
+
+    for ( ; length; length--, offset++) {
+        mask = 0x80 >> (offset & 7);
+        if ((val >> (length - 1)) & 1) data[offset >> 3] |= mask;
+        else data[offset >> 3] &= ~mask;
+    }
+}
+
+/* XORs into the ECC codewords the remainder of the data codewords "first" to
+   "last" of each block, followed by zeros to the end of the block
+ */
+static void sym_addRemainder(rt_uint8_t *codewords,
+    const CodewordReader *layout, rt_uint8_t blockEccLen, rt_uint16_t first,
+    rt_uint16_t last) {
+    rt_uint8_t remainder[30];
+    const rt_uint8_t *coeff;
+    rt_uint16_t blockStart, from, to;
+    rt_uint8_t block, blockSize, i;
+
+    coeff = rs_getGenerator(blockEccLen);
+    blockStart = 0;
+    blockSize = layout->shortDataBlockLen;
+    for (block = 0; block < layout->numBlocks; block++) {
+        if (block == layout->numShortBlocks) blockSize++;
+        if (blockStart > last) break;
+        if (blockStart + blockSize > first) {
+            from = (first > blockStart) ? first : blockStart;
+            to = (last < blockStart + blockSize - 1) ? \
+                last : blockStart + blockSize - 1;
+            rt_memset(remainder, 0x00, blockEccLen);
+            rs_getRemainder(blockEccLen, coeff, &codewords[from],
+                to - from + 1, remainder, 1);
+            rs_getRemainder(blockEccLen, coeff, RT_NULL,
+                blockStart + blockSize - 1 - to, remainder, 1);
+            for (i = 0; i < blockEccLen; i++) {
+                codewords[layout->dataCount + block + i * layout->numBlocks] ^= \
+                    remainder[i];
+            }
+        }
+        blockStart += blockSize;
+    }
+}
+
+/* Draws "byte" again as codeword "index" (in the interleaved order), masked
+   with "mask" unless it is above 7
+ */
+static void sym_drawCodeword(QRSymbol *symbol, BitBucket *modules,
+    FunctionMap *isFunction, rt_uint16_t index, rt_uint8_t byte,
+    rt_uint8_t mask) {
+    rt_uint32_t bit;
+    rt_uint16_t skip;
+    rt_uint8_t size, pairs, low, high, middle, done;
+    rt_uint8_t right, vert, x, y, j, funcs, on;
+
+    size = symbol->qrcode.size;
+    pairs = (size - 1) / 2;
+    bit = (rt_uint32_t)index * 8;
+
+    // The last column pair starting at or before the bit
+    low = 0;
+    high = pairs - 1;
+    while (low < high) {
+        middle = (low + high + 1) / 2;
+        if (symbol->pairBits[middle] <= bit) low = middle;
+        else high = middle - 1;
+    }
+    skip = bit - symbol->pairBits[low];
+
+    for (done = 0; (done < 8) && (low < pairs); low++) {
+        right = sym_getRight(size, low);
+        for (vert = 0; (vert < size) && (done < 8); vert++) {
+            y = (((right & 2) == 0) ^ (right < 6)) ? size - 1 - vert : vert;
+            funcs = fm_getPair(isFunction, right, y);
+            for (j = 0; (j < 2) && (done < 8); j++) {
+                if ((funcs >> j) & 1) continue;
+                if (skip) {
+                    skip--;
+                    continue;
+                }
+                x = right - j;
+                on = (byte >> (7 - done)) & 1;
+                if (mask <= 7) on ^= mask_getBit(mask, x, y);
+                bb_setBit(modules, x, y, on);
+                done++;
+            }
+        }
+    }
+}
+
+/* As qrcode_initBytesEx(), in "workspace" (of qrcode_getWorkspaceSize()
+   bytes) which must be kept with "symbol" to patch it
+ */
+rt_int8_t qrcode_initSymbol(QRSymbol *symbol, rt_uint8_t *modules,
+    rt_uint8_t *workspace, rt_uint8_t version, rt_uint8_t ecc,
+    rt_uint8_t *data, rt_uint16_t length, const QRCodeOptions *options) {
+    QRCodeOptions symbolOptions;
+    FunctionMap isFunction;
+    rt_uint16_t bits;
+    rt_uint8_t pair, right, y, funcs;
+    rt_int8_t ret;
+
+    if (!workspace) return -RT_EINVAL;
+    if (options) symbolOptions = *options;
+    else qrcode_initOptions(&symbolOptions);
+    symbolOptions.workspace = workspace;
+
+    ret = qrcode_initBytesEx(&symbol->qrcode, modules, version, ecc, data,
+        length, &symbolOptions);
+    if (ret < 0) return ret;
+    symbol->workspace = workspace;
+    symbol->length = length;
+
+    sym_getFunctionMap(symbol, &isFunction);
+    bits = 0;
+    for (pair = 0; pair < (symbol->qrcode.size - 1) / 2; pair++) {
+        symbol->pairBits[pair] = bits;
+        right = sym_getRight(symbol->qrcode.size, pair);
+        for (y = 0; y < symbol->qrcode.size; y++) {
+            funcs = fm_getPair(&isFunction, right, y);
+            bits += 2 - (funcs & 1) - (funcs >> 1);
+        }
+    }
+    return RT_EOK;
+}
+
+/* Replaces "length" characters of the data from "offset" with "data" and
+   updates the symbol. The new characters must fit the mode of the symbol
+   (MODE_MIXED symbols can not be patched). With "keepMask" the mask is kept,
+   so the work only depends on the size of the change, otherwise the best one
+   is chosen again.
+ */
+rt_int8_t qrcode_patchSymbol(QRSymbol *symbol, rt_uint16_t offset,
+    const rt_uint8_t *data, rt_uint16_t length, rt_bool_t keepMask) {
+    QRCode *qrcode = &symbol->qrcode;
+    rt_uint8_t *codewords = symbol->workspace;
+    CodewordReader layout;
+    BitBucket modules;
+    FunctionMap isFunction;
+    rt_uint32_t head, from, to, value;
+    rt_uint16_t radix, group, firstGroup, lastGroup, start, first, last;
+    rt_uint16_t blockStart, i, index;
+    rt_uint8_t chars[3];
+    rt_uint8_t eccFormatBits, blockEccLen, groupChars, groupBits, bits, count;
+    rt_uint8_t block, blockSize, mask, k;
+
+    if (!length) return RT_EOK;
+    if ((MODE_MIXED == qrcode->mode) || \
+        ((rt_uint32_t)offset + length > symbol->length)) {
+        return -RT_EINVAL;
+    }
+    for (i = 0; i < length; i++) {
+        value = CHAR_VALUES[data[i]];
+        if (((MODE_NUMERIC == qrcode->mode) && (value >= 10)) || \
+            ((MODE_ALPHANUMERIC == qrcode->mode) && \
+             (CHAR_BYTE_ONLY == value))) {
+            return -RT_EINVAL;
+        }
+    }
+
+    // Characters are encoded in groups: 3 digits, 2 alphanumerics or 1 byte
+    if (MODE_NUMERIC == qrcode->mode) {
+        radix = 10;
+        groupChars = 3;
+        groupBits = 10;
+    } else if (MODE_ALPHANUMERIC == qrcode->mode) {
+        radix = 45;
+        groupChars = 2;
+        groupBits = 11;
+    } else {
+        radix = 256;
+        groupChars = 1;
+        groupBits = 8;
+    }
+    head = 4 + getModeBits(qrcode->version, qrcode->mode);
+    firstGroup = offset / groupChars;
+    lastGroup = (offset + length - 1) / groupChars;
+    // A last group of fewer characters takes fewer bits (4 or 7, or 6)
+    count = (symbol->length - lastGroup * groupChars < groupChars) ? \
+        symbol->length - lastGroup * groupChars : groupChars;
+    from = head + firstGroup * groupBits;
+    to = head + lastGroup * groupBits + \
+        ((count < groupChars) ? count * (groupBits / groupChars) + 1 : \
+            groupBits);
+    first = from / 8;
+    last = (to - 1) / 8;
+
+    eccFormatBits = (ECC_FORMAT_BITS >> (2 * qrcode->ecc)) & 0x03;
+    blockEccLen = cw_init(&layout, qrcode->version, eccFormatBits, codewords);
+
+    // Out with the old codewords, in with the new ones
+    sym_addRemainder(codewords, &layout, blockEccLen, first, last);
+    for (group = firstGroup; group <= lastGroup; group++) {
+        start = group * groupChars;
+        count = (symbol->length - start < groupChars) ? \
+            symbol->length - start : groupChars;
+        bits = (count < groupChars) ? \
+            count * (groupBits / groupChars) + 1 : groupBits;
+
+        value = sym_getBits(codewords, head + group * groupBits, bits);
+        for (k = count; k--; value /= radix) chars[k] = value % radix;
+        for (k = 0; k < count; k++) {
+            if ((start + k < offset) || (start + k >= offset + length))
+                continue;
+            chars[k] = (256 == radix) ? data[start + k - offset] : \
+                CHAR_VALUES[data[start + k - offset]];
+        }
+        for (value = 0, k = 0; k < count; k++) value = value * radix + chars[k];
+        sym_setBits(codewords, head + group * groupBits, value, bits);
+    }
+    sym_addRemainder(codewords, &layout, blockEccLen, first, last);
+
+    // Draw the changed codewords again
+    modules.data = qrcode->modules;
+    modules.bitOffsetOrWidth = qrcode->size;
+    modules.capacityBytes = bb_getGridSizeBytes(qrcode->size);
+    sym_getFunctionMap(symbol, &isFunction);
+    mask = qrcode->mask;
+    if (!keepMask) {
+        applyMask(&modules, &isFunction, mask);
+        mask = 0xff;
+    }
+
+    blockStart = 0;
+    blockSize = layout.shortDataBlockLen;
+    for (block = 0; block < layout.numBlocks; block++) {
+        if (block == layout.numShortBlocks) blockSize++;
+        if (blockStart > last) break;
+        if (blockStart + blockSize > first) {
+            for (i = (first > blockStart) ? first : blockStart;
+                 (i <= last) && (i < blockStart + blockSize); i++) {
+                // The last codeword of the long blocks comes after the others
+                k = i - blockStart;
+                index = (k < layout.shortDataBlockLen) ? \
+                    k * layout.numBlocks + block : \
+                    layout.shortDataBlockLen * layout.numBlocks + block - \
+                        layout.numShortBlocks;
+                sym_drawCodeword(symbol, &modules, &isFunction, index,
+                    codewords[i], mask);
+            }
+            for (k = 0; k < blockEccLen; k++) {
+                index = layout.dataCount + block + k * layout.numBlocks;
+                sym_drawCodeword(symbol, &modules, &isFunction, index,
+                    codewords[index], mask);
+            }
+        }
+        blockStart += blockSize;
+    }
+
+    if (!keepMask) {
+        qrcode->mask = getBestMask(&modules, &isFunction, eccFormatBits,
+            RT_FALSE);
+        applyMask(&modules, &isFunction, qrcode->mask);
+    }
+    return RT_EOK;
+}
+
+/* Wire format
+
+   A 2-byte header holds the format (bits 7-6) and the version (bits 5-0),
+   then the ECC level (bits 7-6), the mask (bits 5-3) and the mode (bits 2-0).
+   It is followed by the modules grid, or by the codewords as an encode leaves
+   them in its workspace (the data codewords block after block, then the ECC
+   ones interleaved), or by the segments only: their length in bits (2 bytes,
+   MSB first), then their bits. The function patterns, the terminator, the pad
+   codewords and the ECC codewords are rebuilt by the receiver from the header
+   alone. For QR_WIRE_DATA, the size is that of a symbol filled to capacity.
+ */
+rt_uint16_t qrcode_getSerializedSize(rt_uint8_t version, rt_uint8_t ecc,
+    rt_uint8_t format) {
+    rt_uint16_t moduleCount;
+
+    #if (LOCK_VERSION == 0)
+        // 0 for QR_VERSION_AUTO and anything out of range
+        if ((version < 1) || (version > 40)) return 0;
+        moduleCount = NUM_RAW_DATA_MODULES[version - 1];
+    #else
+        moduleCount = NUM_RAW_DATA_MODULES;
+    #endif
+    if ((ecc > ECC_HIGH) || (format > QR_WIRE_DATA)) return 0;
+
+    if (QR_WIRE_PACKED == format) {
+        return QR_WIRE_HEADER_SIZE + qrcode_getBufferSize(version);
+    } else if (QR_WIRE_CODEWORDS == format) {
+        return QR_WIRE_HEADER_SIZE + moduleCount / 8;
+    }
+    return QR_WIRE_HEADER_SIZE + 2 + \
+        getDataCapacityBits(version, (ECC_FORMAT_BITS >> (2 * ecc)) & 0x03) / 8;
+}
+
+/* Returns the number of bits of the segments at the start of the data
+   codewords "data" (of "capacity" bytes), up to the terminator
+ */
+static rt_uint32_t getSegmentsBits(rt_uint8_t *data, rt_uint16_t capacity,
+    rt_uint8_t version) {
+    BitBucket segments;
+    rt_uint32_t offset, word, count;
+    rt_uint8_t mode, countBits;
+
+    segments.data = data;
+    segments.capacityBytes = capacity;
+    offset = 0;
+    while (offset + 4 <= capacity * 8U) {
+        word = bb_getWord(&segments, offset);
+        if (!(word >> 28)) return offset;
+        for (mode = MODE_NUMERIC; mode <= MODE_BYTE; mode++) {
+            if ((word >> 28) == (1U << mode)) break;
+        }
+        // Not one of ours: all is sent
+        if (mode > MODE_BYTE) return capacity * 8U;
+
+        countBits = getModeBits(version, mode);
+        count = (word << 4) >> (32 - countBits);
+        offset += 4 + countBits;
+        if (MODE_NUMERIC == mode) {
+            offset += count / 3 * 10 + count % 3 * 3 + !!(count % 3);
+        } else if (MODE_ALPHANUMERIC == mode) {
+            offset += count / 2 * 11 + count % 2 * 6;
+        } else {
+            offset += count * 8;
+        }
+    }
+    return (offset < capacity * 8U) ? offset : capacity * 8U;
+}
+
+/* Reads the first "count" codewords (in the interleaved order) from the data
+   modules, unmasked, to where "order" puts them: the reverse of
+   drawCodewords()
+ */
+static void readCodewords(BitBucket *modules, FunctionMap *isFunction,
+    rt_uint8_t mask, CodewordReader *order, rt_uint8_t *codewords,
+    rt_uint16_t count) {
+    rt_uint32_t i, bitLength, offset;
+    rt_uint8_t byte, funcs, on;
+    rt_uint8_t size, vert, x, y, j;
+    rt_int16_t right;
+
+    size = modules->bitOffsetOrWidth;
+    bitLength = (rt_uint32_t)count * 8;
+    byte = 0;
+    i = 0;
+    for (right = size - 1; (right >= 1) && (i < bitLength); right -= 2) {
+        if (right == 6) right = 5;
+
+        for (vert = 0; vert < size; vert++) {
+            y = (((right & 2) == 0) ^ (right < 6)) ? size - 1 - vert : vert;
+            funcs = fm_getPair(isFunction, right, y);
+            for (j = 0; j < 2; j++) {
+                if (((funcs >> j) & 1) || (i >= bitLength)) continue;
+                x = right - j;
+                offset = y * size + x;
+                on = (modules->data[offset >> 3] >> (7 - (offset & 0x07))) & 1;
+                byte = (byte << 1) | (on ^ mask_getBit(mask, x, y));
+                if (!(++i & 7)) codewords[cw_nextIndex(order)] = byte;
+            }
+        }
+    }
+}
+
+/* Writes "qrcode" to "buffer" (of "size" bytes, at least
+   qrcode_getSerializedSize()) and returns the number of bytes, fewer for
+   QR_WIRE_DATA when the segments leave room in the symbol. But for
+   QR_WIRE_PACKED, the function modules are mapped in "workspace"
+   (qrcode_getWorkspaceSize() bytes, unused with QR_LOW_MEMORY), or in heap if
+   it is RT_NULL.
+ */
+rt_int32_t qrcode_serialize(QRCode *qrcode, rt_uint8_t format,
+    rt_uint8_t *workspace, rt_uint8_t *buffer, rt_uint16_t size) {
+    CodewordReader order;
+    BitBucket modules;
+    FunctionMap isFunction;
+    rt_uint32_t bits;
+    rt_uint16_t length;
+    rt_uint8_t eccFormatBits, *body;
+    #if !QR_LOW_MEMORY
+        rt_uint8_t *grid;
+    #endif
+
+    if (format > QR_WIRE_DATA) return -RT_EINVAL;
+    length = qrcode_getSerializedSize(qrcode->version, qrcode->ecc, format);
+    if (size < length) return -RT_EFULL;
+
+    buffer[0] = (format << 6) | qrcode->version;
+    buffer[1] = (qrcode->ecc << 6) | (qrcode->mask << 3) | qrcode->mode;
+    if (QR_WIRE_PACKED == format) {
+        rt_memcpy(&buffer[QR_WIRE_HEADER_SIZE], qrcode->modules,
+            length - QR_WIRE_HEADER_SIZE);
+        return length;
+    }
+
+    eccFormatBits = (ECC_FORMAT_BITS >> (2 * qrcode->ecc)) & 0x03;
+    modules.data = qrcode->modules;
+    modules.bitOffsetOrWidth = qrcode->size;
+    modules.capacityBytes = bb_getGridSizeBytes(qrcode->size);
+    #if QR_LOW_MEMORY
+        (void)workspace;
+        fm_init(&isFunction, qrcode->version);
+    #else
+        grid = workspace;
+        if (!grid) {
+            grid = (rt_uint8_t *)rt_malloc(modules.capacityBytes);
+            if (!grid) {
+                LOG_W("No Memory");
+                return -RT_ENOMEM;
+            }
+        }
+        // Drawn onto their own map, the function patterns leave just the map
+        bb_initGrid(&isFunction, grid, qrcode->size);
+        drawFunctionPatterns(&isFunction, &isFunction, qrcode->version,
+            eccFormatBits);
+    #endif
+
+    // The data codewords come first in the interleaved order
+    body = &buffer[QR_WIRE_HEADER_SIZE];
+    if (QR_WIRE_DATA == format) body += 2;
+    cw_init(&order, qrcode->version, eccFormatBits, body);
+    readCodewords(&modules, &isFunction, qrcode->mask, &order, body,
+        length - (body - buffer));
+
+    #if !QR_LOW_MEMORY
+        if (!workspace) rt_free(grid);
+    #endif
+    if (QR_WIRE_DATA != format) return length;
+
+    // Only the segments are kept, the receiver pads them again
+    bits = getSegmentsBits(body, length - (body - buffer), qrcode->version);
+    buffer[QR_WIRE_HEADER_SIZE] = bits >> 8;
+    buffer[QR_WIRE_HEADER_SIZE + 1] = bits & 0xff;
+    return (body - buffer) + bb_getBufferSizeBytes(bits);
+}
+
+/* Rebuilds a symbol from "buffer" (of "length" bytes) into "modules". Without
+   heap: "workspace" (qrcode_getWorkspaceSize() bytes) is only needed for
+   QR_WIRE_DATA, and without QR_LOW_MEMORY for QR_WIRE_CODEWORDS. The work is
+   proportional to the number of modules.
+ */
+rt_int8_t qrcode_deserialize(QRCode *qrcode, rt_uint8_t *modules,
+    rt_uint8_t *workspace, const rt_uint8_t *buffer, rt_uint16_t length) {
+    CodewordReader reader;
+    BitBucket modulesGrid, codewords;
+    FunctionMap isFunction;
+    rt_uint16_t moduleCount, codewordSize, dataCapacity, bits = 0;
+    rt_uint8_t version, format, ecc, eccFormatBits, mask, mode, size;
+
+    if (length < QR_WIRE_HEADER_SIZE) return -RT_EINVAL;
+    format = buffer[0] >> 6;
+    version = buffer[0] & 0x3f;
+    ecc = buffer[1] >> 6;
+    mask = (buffer[1] >> 3) & 0x07;
+    mode = buffer[1] & 0x07;
+    #if (LOCK_VERSION == 0)
+        if ((version < 1) || (version > 40)) return -RT_EINVAL;
+        moduleCount = NUM_RAW_DATA_MODULES[version - 1];
+    #else
+        if (version != LOCK_VERSION) return -RT_EINVAL;
+        moduleCount = NUM_RAW_DATA_MODULES;
+    #endif
+    if ((format > QR_WIRE_DATA) || (mode > MODE_MIXED)) return -RT_EINVAL;
+    eccFormatBits = (ECC_FORMAT_BITS >> (2 * ecc)) & 0x03;
+    dataCapacity = getDataCapacityBits(version, eccFormatBits) / 8;
+    if (QR_WIRE_DATA == format) {
+        if (length < QR_WIRE_HEADER_SIZE + 2) return -RT_EINVAL;
+        bits = (buffer[QR_WIRE_HEADER_SIZE] << 8) | \
+            buffer[QR_WIRE_HEADER_SIZE + 1];
+        if ((bits > dataCapacity * 8U) || \
+            (length < QR_WIRE_HEADER_SIZE + 2 + bb_getBufferSizeBytes(bits))) {
+            return -RT_EINVAL;
+        }
+    } else if (length < qrcode_getSerializedSize(version, ecc, format)) {
+        return -RT_EINVAL;
+    }
+    #if QR_LOW_MEMORY
+        if (!workspace && (QR_WIRE_DATA == format)) return -RT_EINVAL;
+    #else
+        if (!workspace && (QR_WIRE_PACKED != format)) return -RT_EINVAL;
+    #endif
+
+    size = version * 4 + 17;
+    qrcode->version = version;
+    qrcode->size = size;
+    qrcode->ecc = ecc;
+    qrcode->mode = mode;
+    qrcode->mask = mask;
+    qrcode->modules = modules;
+    buffer += QR_WIRE_HEADER_SIZE;
+    if (QR_WIRE_PACKED == format) {
+        rt_memcpy(modules, buffer, qrcode_getBufferSize(version));
+        return RT_EOK;
+    }
+
+    codewordSize = bb_getBufferSizeBytes(moduleCount);
+    bb_initGrid(&modulesGrid, modules, size);
+    #if QR_LOW_MEMORY
+        fm_init(&isFunction, version);
+    #else
+        bb_initGrid(&isFunction, workspace + codewordSize, size);
+    #endif
+    drawFunctionPatterns(&modulesGrid, &isFunction, version, eccFormatBits);
+
+    if (QR_WIRE_DATA == format) {
+        bb_initBuffer(&codewords, workspace, codewordSize);
+        rt_memcpy(workspace, buffer + 2, bb_getBufferSizeBytes(bits));
+        // Any bits sent past the segments are dropped
+        if (bits % 8) workspace[bits / 8] &= 0xff << (8 - bits % 8);
+        codewords.bitOffsetOrWidth = bits;
+        bb_appendPadding(&codewords, dataCapacity);
+        performErrorCorrection(version, eccFormatBits, &codewords, &reader);
+    } else {
+        // Placed straight from the buffer
+        cw_init(&reader, version, eccFormatBits, buffer);
+    }
+    // The remainder bits stay white
+    drawCodewords(&modulesGrid, &isFunction, &reader, moduleCount / 8 * 8);
+    drawFormatBits(&modulesGrid, &isFunction, eccFormatBits, mask);
+    applyMask(&modulesGrid, &isFunction, mask);
+    return RT_EOK;
+}
+
+/* Row rendering
+
+   A line is "scale" pixels per module, with "quietZone" light modules on
+   each side. 1bpp lines are built MSB-first through a 32-bit accumulator, 8
+   modules at a time, with the bits spread by word tricks for the scales of 2
+   and 4 (then reversed by a nibble table for LSB-first). Byte per pixel lines
+   take the same 8 modules and shift them out of the byte, and pages transpose
+   the 8 modules of their 8 rows.
+ */
+typedef struct RenderLine {
+    rt_uint8_t *out;
+    rt_uint32_t acc;        // Pending bits, left aligned
+    rt_uint8_t count;       // Number of pending bits, less than 8
+} RenderLine;
+
+static const rt_uint8_t RD_REVERSE_NIBBLE[16] = {
+    0x0, 0x8, 0x4, 0xc, 0x2, 0xa, 0x6, 0xe,
+    0x1, 0x9, 0x5, 0xd, 0x3, 0xb, 0x7, 0xf,
+};
+
+// Appends "length" (1 to 24) bits
+static void rd_putBits(RenderLine *line, rt_uint32_t bits,
+    rt_uint8_t length) {
+    line->acc |= (bits << (32 - length)) >> line->count;
+    line->count += length;
+    while (line->count >= 8) {
+        *line->out++ = line->acc >> 24;
+        line->acc <<= 8;
+        line->count -= 8;
+    }
+}
+
+static void rd_putRun(RenderLine *line, rt_bool_t dark, rt_uint32_t length) {
+    rt_uint8_t chunk;
+
+    while (length) {
+        chunk = (length > 24) ? 24 : length;
+        rd_putBits(line, dark ? 0xFFFFFF : 0, chunk);
+        length -= chunk;
+    }
+}
+
+// Each bit twice: bit i of "bits" goes to bits 2i and 2i + 1
+static rt_uint32_t rd_spread2(rt_uint8_t bits) {
+    rt_uint32_t x = bits;
+
+    x = (x | (x << 4)) & 0x0F0F;
+    x = (x | (x << 2)) & 0x3333;
+    x = (x | (x << 1)) & 0x5555;
+    return x | (x << 1);
+}
+
+// Each bit 4 times: bit i of "bits" goes to bits 4i to 4i + 3
+static rt_uint32_t rd_spread4(rt_uint8_t bits) {
+    rt_uint32_t x = bits;
+
+    x = (x | (x << 12)) & 0x000F000F;
+    x = (x | (x << 6)) & 0x03030303;
+    x = (x | (x << 3)) & 0x11111111;
+    return x * 0x0F;
+}
+
+// The "count" (1 to 8) modules in the MSBs of "bits"
+static void rd_putModules(RenderLine *line, rt_uint8_t bits,
+    rt_uint8_t count, rt_uint8_t scale) {
+    rt_uint32_t spread;
+    rt_uint8_t i;
+
+    if (1 == scale) {
+        rd_putBits(line, bits >> (8 - count), count);
+    } else if (2 == scale) {
+        rd_putBits(line, rd_spread2(bits) >> (16 - 2 * count), 2 * count);
+    } else if (4 == scale) {
+        spread = rd_spread4(bits);
+        if (count > 4) {
+            rd_putBits(line, spread >> 16, 16);
+            rd_putBits(line, (spread & 0xFFFF) >> (32 - 4 * count),
+                4 * count - 16);
+        } else {
+            rd_putBits(line, spread >> (32 - 4 * count), 4 * count);
+        }
+    } else {
+        for (i = 0; i < count; i++, bits <<= 1) {
+            rd_putRun(line, (bits & 0x80) != 0, scale);
+        }
+    }
+}
+
+// The 8 modules of row y from column x (0 past the row)
+static rt_uint8_t rd_getModules(QRCode *qrcode, rt_uint8_t x, rt_uint8_t y) {
+    rt_uint32_t offset, index;
+    rt_uint16_t bufferBytes;
+    rt_uint8_t bits, shift;
+
+    bufferBytes = bb_getGridSizeBytes(qrcode->size);
+    offset = y * qrcode->size + x;
+    index = offset >> 3;
+    shift = offset & 0x07;
+    bits = qrcode->modules[index] << shift;
+    if (shift && (index + 1 < bufferBytes))
+        bits |= qrcode->modules[index + 1] >> (8 - shift);
+    if (qrcode->size - x < 8) bits &= 0xFF << (8 - (qrcode->size - x));
+    return bits;
+}
+
+// Module (x, y) counted from the corner of the quiet zone, light outside
+static rt_bool_t rd_getModule(QRCode *qrcode, rt_int16_t x, rt_int16_t y) {
+    if ((x < 0) || (y < 0) || (x >= qrcode->size) || (y >= qrcode->size))
+        return RT_FALSE;
+    return qrcode_getModule(qrcode, x, y);
+}
+
+/* Transposes 8 rows of 8 modules (column 0 in the MSB) into 8 columns, row i
+   in bit i.
+   See: Hacker's Delight, 7-3 "Transposing a Bit Matrix"
+ */
+static void rd_transpose8(rt_uint8_t *rows) {
+    rt_uint32_t x, y, t;
+
+    // The last row first, so that it ends up in the MSB
+    x = ((rt_uint32_t)rows[7] << 24) | ((rt_uint32_t)rows[6] << 16) | \
+        ((rt_uint32_t)rows[5] << 8) | rows[4];
+    y = ((rt_uint32_t)rows[3] << 24) | ((rt_uint32_t)rows[2] << 16) | \
+        ((rt_uint32_t)rows[1] << 8) | rows[0];
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA;  x = x ^ t ^ (t << 7);
+    t = (y ^ (y >> 7)) & 0x00AA00AA;  y = y ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC; x = x ^ t ^ (t << 14);
+    t = (y ^ (y >> 14)) & 0x0000CCCC; y = y ^ t ^ (t << 14);
+    t = (x & 0xF0F0F0F0) | ((y >> 4) & 0x0F0F0F0F);
+    y = ((x << 4) & 0xF0F0F0F0) | (y & 0x0F0F0F0F);
+    x = t;
+
+    rows[0] = x >> 24;
+    rows[1] = x >> 16;
+    rows[2] = x >> 8;
+    rows[3] = x;
+    rows[4] = y >> 24;
+    rows[5] = y >> 16;
+    rows[6] = y >> 8;
+    rows[7] = y;
+}
+
+void qrcode_initRenderOptions(QRRenderOptions *options) {
+    options->format = QR_RENDER_1BPP_MSB;
+    options->scale = 1;
+    options->quietZone = 4;
+    options->invert = RT_FALSE;
+}
+
+// Pixels per side, 0 if too many
+rt_uint16_t qrcode_getRenderSize(QRCode *qrcode,
+    const QRRenderOptions *options) {
+    rt_uint32_t pixels;
+
+    pixels = ((rt_uint32_t)qrcode->size + 2 * options->quietZone) * \
+        options->scale;
+    return (pixels > 0xFFFF) ? 0 : pixels;
+}
+
+rt_uint32_t qrcode_getRowBytes(QRCode *qrcode,
+    const QRRenderOptions *options) {
+    rt_uint32_t pixels = qrcode_getRenderSize(qrcode, options);
+
+    switch (options->format) {
+    case QR_RENDER_1BPP_MSB:
+    case QR_RENDER_1BPP_LSB:
+        return (pixels + 7) / 8;
+    case QR_RENDER_RGB565:
+        return 2 * pixels;
+    default:
+        return pixels;
+    }
+}
+
+/* Fills "line" (qrcode_getRowBytes()) with the pixel row y, or with the 8
+   pixel rows from y (a multiple of 8) for QR_RENDER_PAGE. Pixels past the
+   symbol (padding bits, rows below it) are light.
+ */
+rt_int8_t qrcode_renderRow(QRCode *qrcode, const QRRenderOptions *options,
+    rt_uint16_t y, rt_uint8_t *line) {
+    RenderLine bits;
+    rt_uint32_t i, rowBytes;
+    rt_int16_t x, moduleY, rows[8];
+    rt_uint16_t pixels;
+    rt_uint8_t scale, quiet, size, count, r, light, dark, value, width, pixel;
+    rt_uint8_t modules[8];
+
+    pixels = qrcode_getRenderSize(qrcode, options);
+    scale = options->scale;
+    if (!scale || !pixels || (options->format > QR_RENDER_RGB565) || \
+        (y >= pixels) || ((QR_RENDER_PAGE == options->format) && (y & 0x07))) {
+        return -RT_EINVAL;
+    }
+    quiet = options->quietZone;
+    size = qrcode->size;
+    moduleY = y / scale - quiet;
+    light = options->invert ? 0xFF : 0x00;
+
+    switch (options->format) {
+    case QR_RENDER_1BPP_MSB:
+    case QR_RENDER_1BPP_LSB:
+        rowBytes = (pixels + 7) / 8;
+        if ((moduleY < 0) || (moduleY >= size)) {
+            rt_memset(line, light, rowBytes);
+            return RT_EOK;
+        }
+        bits.out = line;
+        bits.acc = 0;
+        bits.count = 0;
+        rd_putRun(&bits, RT_FALSE, (rt_uint32_t)quiet * scale);
+        for (x = 0; x < size; x += 8) {
+            rd_putModules(&bits, rd_getModules(qrcode, x, moduleY),
+                (size - x < 8) ? size - x : 8, scale);
+        }
+        rd_putRun(&bits, RT_FALSE, (rt_uint32_t)quiet * scale);
+        if (bits.count) *bits.out = bits.acc >> 24;
+
+        for (i = 0; i < rowBytes; i++) {
+            value = line[i] ^ light;
+            if (QR_RENDER_1BPP_LSB == options->format) {
+                value = (RD_REVERSE_NIBBLE[value & 0x0F] << 4) | \
+                    RD_REVERSE_NIBBLE[value >> 4];
+            }
+            line[i] = value;
+        }
+        break;
+
+    case QR_RENDER_PAGE:
+        // Rows outside the symbol stay light
+        for (r = 0; r < 8; r++) {
+            rows[r] = (y + r < pixels) ? (y + r) / scale - quiet : -1;
+            if (rows[r] >= size) rows[r] = -1;
+        }
+        rt_memset(line, light, (rt_uint32_t)quiet * scale);
+        line += (rt_uint32_t)quiet * scale;
+        for (x = 0; x < size; x += 8) {
+            // A scaled row is fetched once
+            for (r = 0; r < 8; r++) {
+                if (rows[r] < 0) modules[r] = 0;
+                else if (r && (rows[r] == rows[r - 1]))
+                    modules[r] = modules[r - 1];
+                else modules[r] = rd_getModules(qrcode, x, rows[r]);
+            }
+            rd_transpose8(modules);
+            count = (size - x < 8) ? size - x : 8;
+            for (r = 0; r < count; r++) {
+                rt_memset(line, modules[r] ^ light, scale);
+                line += scale;
+            }
+        }
+        rt_memset(line, light, (rt_uint32_t)quiet * scale);
+        break;
+
+    default:
+        dark = light;
+        light = ~dark;
+        width = (QR_RENDER_GRAY8 == options->format) ? scale : 2 * scale;
+        rowBytes = (rt_uint32_t)pixels * (width / scale);
+        if ((moduleY < 0) || (moduleY >= size)) {
+            rt_memset(line, light, rowBytes);
+            return RT_EOK;
+        }
+        rt_memset(line, light, (rt_uint32_t)quiet * width);
+        line += (rt_uint32_t)quiet * width;
+        for (x = 0; x < size; x += 8) {
+            value = rd_getModules(qrcode, x, moduleY);
+            count = (size - x < 8) ? size - x : 8;
+            for (r = 0; r < count; r++, value <<= 1) {
+                pixel = (value & 0x80) ? dark : light;
+                for (i = 0; i < width; i++) *line++ = pixel;
+            }
+        }
+        rt_memset(line, light, (rt_uint32_t)quiet * width);
+        break;
+    }
+    return RT_EOK;
+}
+
+/* Dirty regions
+
+   The modules of two symbols are compared 32 at a time, and the runs of
+   changed modules of a row found by counting leading zeros. A run continues
+   the region of the same columns ending on the row above, if any, so that
+   changes of the same shape down several rows make one rectangle.
+ */
+#if defined(__GNUC__)
+# define df_leadingZeros(x)         __builtin_clz(x)
+#else
+static rt_uint8_t df_leadingZeros(rt_uint32_t x) {
+    rt_uint8_t n = 0;
+
+    if (!(x & 0xFFFF0000)) { n += 16; x <<= 16; }
+    if (!(x & 0xFF000000)) { n += 8; x <<= 8; }
+    if (!(x & 0xF0000000)) { n += 4; x <<= 4; }
+    if (!(x & 0xC0000000)) { n += 2; x <<= 2; }
+    if (!(x & 0x80000000)) { n += 1; }
+    return n;
+}
+#endif
+
+typedef struct DirtyList {
+    QRRect *rects;
+    rt_uint32_t count;
+    rt_uint32_t max;
+    rt_uint32_t openFrom;       // Regions before it end above the last row
+    rt_uint32_t rowFrom;        // First region reached by the current row
+    rt_uint16_t origin;         // Pixels of the quiet zone
+    rt_uint8_t scale;
+} DirtyList;
+
+static void df_addRun(DirtyList *list, rt_uint8_t y, rt_uint8_t from,
+    rt_uint8_t to) {
+    QRRect *rect;
+    rt_uint32_t i;
+    rt_uint16_t left, top, width, right, bottom;
+
+    left = list->origin + from * list->scale;
+    top = list->origin + y * list->scale;
+    width = (to - from) * list->scale;
+
+    for (i = list->openFrom; i < list->count; i++) {
+        rect = &list->rects[i];
+        if ((rect->x == left) && (rect->width == width) && \
+            (rect->y + rect->height == top)) {
+            rect->height += list->scale;
+            break;
+        }
+    }
+    if (i == list->count) {
+        if (list->count < list->max) {
+            rect = &list->rects[list->count++];
+            rect->x = left;
+            rect->y = top;
+            rect->width = width;
+            rect->height = list->scale;
+        } else {
+            // Out of regions: the last one grows to cover the rest
+            i = list->count - 1;
+            rect = &list->rects[i];
+            right = rect->x + rect->width;
+            bottom = rect->y + rect->height;
+            if (left < rect->x) rect->x = left;
+            if (top < rect->y) rect->y = top;
+            if (left + width > right) right = left + width;
+            if (top + list->scale > bottom) bottom = top + list->scale;
+            rect->width = right - rect->x;
+            rect->height = bottom - rect->y;
+        }
+    }
+    if (i < list->rowFrom) list->rowFrom = i;
+}
+
+/* Fills "rects" with the regions (at the scale and with the quiet zone of
+   "options") where two symbols of the same size differ, and returns how many
+   there are (0 if none). Beyond "maxRects" regions, the last one grows to
+   cover the rest.
+ */
+rt_int32_t qrcode_getDirtyRects(QRCode *before, QRCode *after,
+    const QRRenderOptions *options, QRRect *rects, rt_uint16_t maxRects) {
+    DirtyList list;
+    BitBucket gridBefore, gridAfter;
+    rt_uint32_t offset, word, rest;
+    rt_int16_t start;
+    rt_uint8_t size, x, y, pos;
+
+    size = before->size;
+    if ((after->size != size) || !options->scale || !maxRects || \
+        !qrcode_getRenderSize(before, options)) {
+        return -RT_EINVAL;
+    }
+    gridBefore.data = before->modules;
+    gridBefore.bitOffsetOrWidth = size;
+    gridBefore.capacityBytes = bb_getGridSizeBytes(size);
+    gridAfter = gridBefore;
+    gridAfter.data = after->modules;
+
+    list.rects = rects;
+    list.count = 0;
+    list.max = maxRects;
+    list.openFrom = 0;
+    list.origin = options->quietZone * options->scale;
+    list.scale = options->scale;
+
+    for (y = 0; y < size; y++) {
+        list.rowFrom = list.count;
+        start = -1;
+        for (x = 0; x < size; x += 32) {
+            offset = y * size + x;
+            word = bb_getWord(&gridBefore, offset) ^ \
+                bb_getWord(&gridAfter, offset);
+            // The bits past the end of the row belong to the next one
+            if (size - x < 32) word &= ~(0xFFFFFFFF >> (size - x));
+
+            for (pos = 0; pos < 32; ) {
+                if (start < 0) {
+                    rest = word << pos;
+                    if (!rest) break;
+                    pos += df_leadingZeros(rest);
+                    start = x + pos;
+                } else {
+                    // The run goes on into the next word
+                    rest = ~word << pos;
+                    if (!rest) break;
+                    pos += df_leadingZeros(rest);
+                    df_addRun(&list, y, start, x + pos);
+                    start = -1;
+                }
+            }
+        }
+        if (start >= 0) df_addRun(&list, y, start, size);
+        list.openFrom = list.rowFrom;
+    }
+    return list.count;
+}
+
+/* Terminal rendering
+
+   A text line holds two module rows: each column is a space, an upper half
+   block, a lower half block or a full block, so the modules come out about
+   square in a terminal.
+ */
+typedef struct TermGlyphs {
+    char glyph[4][4];       // By (upper dark) << 1 | (lower dark)
+    rt_uint8_t length;      // Bytes of a block glyph
+} TermGlyphs;
+
+static const TermGlyphs TERM_GLYPHS[2] = {
+    // QR_TERM_UTF8
+    {{ " ", "\xe2\x96\x84", "\xe2\x96\x80", "\xe2\x96\x88" }, 3},
+    // QR_TERM_CP437
+    {{ " ", "\xdc", "\xdf", "\xdb" }, 1},
+};
+
+void qrcode_initTermOptions(QRTermOptions *options) {
+    options->charset = QR_TERM_UTF8;
+    options->quietZone = 2;
+    options->invert = RT_FALSE;
+}
+
+rt_uint16_t qrcode_getTermLines(QRCode *qrcode, const QRTermOptions *options) {
+    return (qrcode->size + 2 * options->quietZone + 1) / 2;
+}
+
+// Bytes of a line, with the newline and the terminating '\0'
+rt_uint16_t qrcode_getTermLineSize(QRCode *qrcode,
+    const QRTermOptions *options) {
+    return (qrcode->size + 2 * options->quietZone) * \
+        ((QR_TERM_CP437 == options->charset) ? 1 : 3) + 2;
+}
+
+/* Fills "buffer" (qrcode_getTermLineSize()) with the text line "line" and
+   returns its length, so a whole line is written at once (e.g. by rt_kputs())
+ */
+rt_int16_t qrcode_renderTermLine(QRCode *qrcode, const QRTermOptions *options,
+    rt_uint16_t line, char *buffer) {
+    const TermGlyphs *glyphs;
+    char *out = buffer;
+    rt_int16_t x, upper, lower, right;
+    rt_uint8_t index, invert;
+    rt_bool_t blank;
+
+    if ((options->charset > QR_TERM_CP437) || \
+        (line >= qrcode_getTermLines(qrcode, options))) {
+        return -RT_EINVAL;
+    }
+    glyphs = &TERM_GLYPHS[options->charset];
+    upper = 2 * line - options->quietZone;
+    lower = upper + 1;
+    right = qrcode->size + options->quietZone;
+    invert = options->invert ? 0x03 : 0x00;
+    // The row below the quiet zone of an odd height is blank
+    blank = (lower >= right);
+
+    for (x = -options->quietZone; x < right; x++) {
+        index = (rd_getModule(qrcode, x, upper) << 1) | \
+            rd_getModule(qrcode, x, lower);
+        if (blank) index = (index ^ invert) & 0x02;
+        else index ^= invert;
+        if (index) {
+            rt_memcpy(out, glyphs->glyph[index], glyphs->length);
+            out += glyphs->length;
+        } else {
+            *out++ = ' ';
+        }
+    }
+    *out++ = '\n';
+    *out = '\0';
+    return out - buffer;
+}
+
+/* File export
+
+   Files are written through a QRWriter from a buffer of one scaled row
+   (qrcode_getExportBufferSize()), never from a whole raster: each module row
+   is rendered once and written "scale" times. PNG image data is left
+   uncompressed in stored deflate blocks, one per pixel row, so only the
+   CRC-32 of the chunk and the Adler-32 of the zlib stream are worked out as
+   the rows go.
+ */
+#define EX_MIN_BUFFER               64
+
+typedef struct Exporter {
+    QRWriter write;
+    void *context;
+    rt_uint8_t *buffer;
+    rt_uint32_t size;       // Bytes of buffer
+    rt_uint32_t used;       // Bytes of text pending in buffer
+    rt_uint32_t total;      // Bytes written
+    rt_int8_t error;
+} Exporter;
+
+// CRC-32 (of PNG) of each nibble, as 16 entries are enough for a few KB rows
+static const rt_uint32_t EX_CRC32_NIBBLE[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+    0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+// Continues "crc" (started from 0xFFFFFFFF and inverted at the end)
+static rt_uint32_t ex_crc32(rt_uint32_t crc, const rt_uint8_t *data,
+    rt_uint32_t length) {
+    while (length--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ EX_CRC32_NIBBLE[crc & 0x0F];
+        crc = (crc >> 4) ^ EX_CRC32_NIBBLE[crc & 0x0F];
+    }
+    return crc;
+}
+
+// Continues "adler" (started from 1)
+static rt_uint32_t ex_adler32(rt_uint32_t adler, const rt_uint8_t *data,
+    rt_uint32_t length) {
+    rt_uint32_t a = adler & 0xFFFF, b = adler >> 16, chunk;
+
+    while (length) {
+        // The sums do not overflow within 5552 bytes
+        chunk = (length > 5552) ? 5552 : length;
+        length -= chunk;
+        while (chunk--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+static void ex_putU32(rt_uint8_t *out, rt_uint32_t value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static void ex_write(Exporter *ex, const rt_uint8_t *data,
+    rt_uint32_t length) {
+    rt_int32_t written;
+
+    while (length && (RT_EOK == ex->error)) {
+        written = ex->write(ex->context, data, length);
+        if ((written <= 0) || ((rt_uint32_t)written > length)) {
+            ex->error = -RT_EIO;
+            break;
+        }
+        data += written;
+        length -= written;
+        ex->total += written;
+    }
+}
+
+static void ex_flush(Exporter *ex) {
+    ex_write(ex, ex->buffer, ex->used);
+    ex->used = 0;
+}
+
+// Appends text to the buffer, written once full
+static void ex_put(Exporter *ex, const char *text, rt_uint32_t length) {
+    if (ex->used + length > ex->size) ex_flush(ex);
+    if (length > ex->size) {
+        ex_write(ex, (const rt_uint8_t *)text, length);
+        return;
+    }
+    rt_memcpy(&ex->buffer[ex->used], text, length);
+    ex->used += length;
+}
+
+static void ex_putText(Exporter *ex, const char *text) {
+    ex_put(ex, text, rt_strlen(text));
+}
+
+static void ex_putNumber(Exporter *ex, rt_uint32_t value) {
+    char digits[10];
+    rt_uint8_t i = sizeof(digits);
+
+    do {
+        digits[--i] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    ex_put(ex, &digits[i], sizeof(digits) - i);
+}
+
+static void ex_writePbm(Exporter *ex, QRCode *qrcode,
+    const QRRenderOptions *options, rt_uint16_t pixels) {
+    QRRenderOptions bits = *options;
+    rt_uint32_t rowBytes, y;
+    rt_uint8_t r;
+
+    ex_putText(ex, "P4\n");
+    ex_putNumber(ex, pixels);
+    ex_putText(ex, " ");
+    ex_putNumber(ex, pixels);
+    ex_putText(ex, "\n");
+    ex_flush(ex);
+
+    // P4 rows are 1bpp MSB-first, with dark pixels as 1
+    bits.format = QR_RENDER_1BPP_MSB;
+    rowBytes = qrcode_getRowBytes(qrcode, &bits);
+    for (y = 0; (y < pixels) && (RT_EOK == ex->error); y += bits.scale) {
+        qrcode_renderRow(qrcode, &bits, y, ex->buffer);
+        for (r = 0; r < bits.scale; r++) {
+            ex_write(ex, ex->buffer, rowBytes);
+        }
+    }
+}
+
+/* The view box is in modules, and each run of dark modules of a row is a
+   rectangle of the path
+ */
+static void ex_writeSvg(Exporter *ex, QRCode *qrcode,
+    const QRRenderOptions *options, rt_uint16_t pixels) {
+    rt_uint16_t width;
+    rt_uint8_t x, y, from, quiet;
+
+    quiet = options->quietZone;
+    width = qrcode->size + 2 * quiet;
+    ex_putText(ex, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"");
+    ex_putNumber(ex, pixels);
+    ex_putText(ex, "\" height=\"");
+    ex_putNumber(ex, pixels);
+    ex_putText(ex, "\" viewBox=\"0 0 ");
+    ex_putNumber(ex, width);
+    ex_putText(ex, " ");
+    ex_putNumber(ex, width);
+    ex_putText(ex, "\" shape-rendering=\"crispEdges\">\n<rect width=\"");
+    ex_putNumber(ex, width);
+    ex_putText(ex, "\" height=\"");
+    ex_putNumber(ex, width);
+    ex_putText(ex, "\" fill=\"");
+    ex_putText(ex, options->invert ? "#000" : "#fff");
+    ex_putText(ex, "\"/>\n<path fill=\"");
+    ex_putText(ex, options->invert ? "#fff" : "#000");
+    ex_putText(ex, "\" d=\"");
+
+    for (y = 0; (y < qrcode->size) && (RT_EOK == ex->error); y++) {
+        for (x = 0; x < qrcode->size; ) {
+            if (!qrcode_getModule(qrcode, x, y)) {
+                x++;
+                continue;
+            }
+            from = x;
+            while ((x < qrcode->size) && qrcode_getModule(qrcode, x, y)) x++;
+            ex_putText(ex, "M");
+            ex_putNumber(ex, from + quiet);
+            ex_putText(ex, " ");
+            ex_putNumber(ex, y + quiet);
+            ex_putText(ex, "h");
+            ex_putNumber(ex, x - from);
+            ex_putText(ex, "v1h-");
+            ex_putNumber(ex, x - from);
+            ex_putText(ex, "z");
+        }
+    }
+    ex_putText(ex, "\"/>\n</svg>\n");
+    ex_flush(ex);
+}
+
+/* A single IDAT chunk, as its length is known: the zlib header, then for each
+   pixel row a stored block (its 5-byte header, the filter byte and the row),
+   then the Adler-32
+ */
+static void ex_writePng(Exporter *ex, QRCode *qrcode,
+    const QRRenderOptions *options, rt_uint16_t pixels) {
+    static const rt_uint8_t SIGNATURE[8] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n',
+    };
+    QRRenderOptions bits = *options;
+    rt_uint8_t head[8 + 25 + 8 + 2], tail[4 + 4 + 12];
+    rt_uint8_t *line = ex->buffer;
+    rt_uint32_t rowBytes, crc, adler, y;
+    rt_uint8_t r;
+
+    // Gray level 0 is black, so dark pixels are 0
+    bits.format = QR_RENDER_1BPP_MSB;
+    bits.invert = !options->invert;
+    rowBytes = qrcode_getRowBytes(qrcode, &bits);
+
+    rt_memcpy(head, SIGNATURE, sizeof(SIGNATURE));
+    ex_putU32(&head[8], 13);
+    rt_memcpy(&head[12], "IHDR", 4);
+    ex_putU32(&head[16], pixels);
+    ex_putU32(&head[20], pixels);
+    head[24] = 1;           // Bit depth
+    head[25] = 0;           // Grayscale
+    head[26] = 0;           // Deflate
+    head[27] = 0;           // Adaptive filtering
+    head[28] = 0;           // Not interlaced
+    ex_putU32(&head[29], ~ex_crc32(0xFFFFFFFF, &head[12], 4 + 13));
+    ex_putU32(&head[33], 2 + (rt_uint32_t)pixels * (5 + 1 + rowBytes) + 4);
+    rt_memcpy(&head[37], "IDAT", 4);
+    head[41] = 0x78;        // Deflate, 32 KB window
+    head[42] = 0x01;        // No preset dictionary, fastest
+    ex_write(ex, head, sizeof(head));
+    crc = ex_crc32(0xFFFFFFFF, &head[37], 4 + 2);
+    adler = 1;
+
+    line[1] = (1 + rowBytes) & 0xFF;
+    line[2] = (1 + rowBytes) >> 8;
+    line[3] = ~line[1];
+    line[4] = ~line[2];
+    line[5] = 0;            // No filter
+    for (y = 0; (y < pixels) && (RT_EOK == ex->error); y += bits.scale) {
+        qrcode_renderRow(qrcode, &bits, y, &line[6]);
+        for (r = 0; r < bits.scale; r++) {
+            line[0] = (y + r + 1 == pixels) ? 0x01 : 0x00;  // Last block
+            crc = ex_crc32(crc, line, 6 + rowBytes);
+            adler = ex_adler32(adler, &line[5], 1 + rowBytes);
+            ex_write(ex, line, 6 + rowBytes);
+        }
+    }
+
+    ex_putU32(tail, adler);
+    ex_putU32(&tail[4], ~ex_crc32(crc, tail, 4));
+    ex_putU32(&tail[8], 0);
+    rt_memcpy(&tail[12], "IEND", 4);
+    ex_putU32(&tail[16], ~ex_crc32(0xFFFFFFFF, &tail[12], 4));
+    ex_write(ex, tail, sizeof(tail));
+}
+
+// Bytes of the buffer of qrcode_export(), about one scaled row
+rt_uint32_t qrcode_getExportBufferSize(QRCode *qrcode, rt_uint8_t format,
+    const QRRenderOptions *options) {
+    QRRenderOptions bits = *options;
+    rt_uint32_t size;
+
+    bits.format = QR_RENDER_1BPP_MSB;
+    switch (format) {
+    case QR_EXPORT_PBM:
+        size = qrcode_getRowBytes(qrcode, &bits);
+        break;
+    case QR_EXPORT_PNG:
+        size = 5 + 1 + qrcode_getRowBytes(qrcode, &bits);
+        break;
+    default:
+        // The path of a row at once, up to 8 bytes per module
+        size = 8 * ((rt_uint32_t)qrcode->size + 2 * options->quietZone);
+        break;
+    }
+    return (size < EX_MIN_BUFFER) ? EX_MIN_BUFFER : size;
+}
+
+/* Writes "qrcode" as a file of "format", at the scale, with the quiet zone
+   and the colors of "options" (but its format), through "write" and returns
+   the number of bytes written. "buffer" is of qrcode_getExportBufferSize()
+   bytes, or taken from heap if it is RT_NULL.
+ */
+rt_int32_t qrcode_export(QRCode *qrcode, rt_uint8_t format,
+    const QRRenderOptions *options, QRWriter write, void *context,
+    rt_uint8_t *buffer) {
+    Exporter ex;
+    rt_uint16_t pixels;
+
+    pixels = qrcode_getRenderSize(qrcode, options);
+    if (!options->scale || !pixels || (format > QR_EXPORT_PNG) || !write) {
+        return -RT_EINVAL;
+    }
+    ex.write = write;
+    ex.context = context;
+    ex.buffer = buffer;
+    ex.size = qrcode_getExportBufferSize(qrcode, format, options);
+    ex.used = 0;
+    ex.total = 0;
+    ex.error = RT_EOK;
+    if (!buffer) {
+        ex.buffer = (rt_uint8_t *)rt_malloc(ex.size);
+        if (!ex.buffer) {
+            LOG_W("No Memory");
+            return -RT_ENOMEM;
+        }
+    }
+
+    switch (format) {
+    case QR_EXPORT_PBM:
+        ex_writePbm(&ex, qrcode, options, pixels);
+        break;
+    case QR_EXPORT_SVG:
+        ex_writeSvg(&ex, qrcode, options, pixels);
+        break;
+    default:
+        ex_writePng(&ex, qrcode, options, pixels);
+        break;
+    }
+
+    if (!buffer) rt_free(ex.buffer);
+    return (RT_EOK != ex.error) ? ex.error : (rt_int32_t)ex.total;
+}
+
+#if QR_EXPORT_FD
+/* QRWriter to the file descriptor in "context", as in
+   qrcode_export(&qrcode, QR_EXPORT_PNG, &options, qrcode_writeFd,
+       (void *)(rt_base_t)fd, RT_NULL)
+ */
+rt_int32_t qrcode_writeFd(void *context, const void *data, rt_size_t length) {
+    return write((int)(rt_base_t)context, data, length);
+}
+#endif
+
+#if QR_SERVICE
+/* Encoder service
+
+   Callers only post a pointer to their request to the message queue, which
+   never blocks: a full queue is -RT_EFULL. Between two encodes, the service
+   thread takes every queued request into the pending one of its slot, where
+   a newer request supersedes (and completes with -RT_EINTR) the older one
+   but keeps its place in line. The next encode is the pending request of the
+   lowest priority, then of the lowest sequence, in the workspace allocated
+   at start, so encodes take no heap.
+ */
+#define SV_NAME                     "qrcode"
+
+void qrcode_initRequest(QRRequest *request) {
+    rt_memset(request, 0, sizeof(*request));
+    request->ecc = ECC_LOW;
+    qrcode_initOptions(&request->options);
+    request->result = RT_EOK;
+}
+
+static void sv_complete(QRRequest *request, rt_int8_t result) {
+    void (*done)(QRRequest *request) = request->done;
+    rt_sem_t sem = request->sem;
+    rt_event_t event = request->event;
+    rt_uint32_t set = request->set;
+
+    // The caller may take the request back as soon as it is signaled
+    request->result = result;
+    if (done) done(request);
+    if (sem) rt_sem_release(sem);
+    if (event) rt_event_send(event, set);
+}
+
+static void sv_queue(QRService *service, QRRequest *request) {
+    QRRequest *old = service->pending[request->slot];
+
+    if (old) {
+        request->sequence = old->sequence;
+        service->superseded++;
+        sv_complete(old, -RT_EINTR);
+    } else {
+        request->sequence = service->sequence++;
+    }
+    service->pending[request->slot] = request;
+}
+
+// Takes the next pending request, or RT_NULL
+static QRRequest *sv_next(QRService *service) {
+    QRRequest *request, *next = RT_NULL;
+    rt_uint8_t slot, nextSlot = 0;
+
+    for (slot = 0; slot < QR_SERVICE_SLOTS; slot++) {
+        request = service->pending[slot];
+        if (!request) continue;
+        if (!next || (request->priority < next->priority) || \
+            ((request->priority == next->priority) && \
+             ((rt_int32_t)(request->sequence - next->sequence) < 0))) {
+            next = request;
+            nextSlot = slot;
+        }
+    }
+    if (next) service->pending[nextSlot] = RT_NULL;
+    return next;
+}
+
+static void sv_run(void *parameter) {
+    QRService *service = (QRService *)parameter;
+    QRCodeOptions options;
+    QRRequest *request;
+    rt_int32_t timeout;
+    rt_uint8_t slot;
+    rt_bool_t stop = RT_FALSE;
+
+    while (!stop) {
+        // Wait only when nothing is pending. rt_mq_recv() returns RT_EOK or
+        // the size received, depending on the RT-Thread version.
+        timeout = RT_WAITING_FOREVER;
+        for (slot = 0; slot < QR_SERVICE_SLOTS; slot++) {
+            if (service->pending[slot]) timeout = RT_WAITING_NO;
+        }
+        while (rt_mq_recv(service->queue, &request, sizeof(request),
+            timeout) >= 0) {
+            if (!request) {
+                stop = RT_TRUE;
+                break;
+            }
+            sv_queue(service, request);
+            timeout = RT_WAITING_NO;
+        }
+        if (stop) break;
+
+        request = sv_next(service);
+        if (!request) continue;
+        options = request->options;
+        options.workspace = service->workspace;
+        service->encoded++;
+        sv_complete(request, qrcode_initBytesEx(&request->qrcode,
+            request->modules, request->version, request->ecc,
+            (rt_uint8_t *)request->data, request->length, &options));
+    }
+
+    // Cancel the pending and the queued requests
+    for (slot = 0; slot < QR_SERVICE_SLOTS; slot++) {
+        if (service->pending[slot]) sv_complete(service->pending[slot],
+            -RT_EINTR);
+        service->pending[slot] = RT_NULL;
+    }
+    while (rt_mq_recv(service->queue, &request, sizeof(request),
+        RT_WAITING_NO) >= 0) {
+        if (request) sv_complete(request, -RT_EINTR);
+    }
+    rt_sem_release(service->stopped);
+}
+
+static void sv_free(QRService *service) {
+    if (service->queue) rt_mq_delete(service->queue);
+    if (service->stopped) rt_sem_delete(service->stopped);
+    rt_free(service->workspace);
+    service->queue = RT_NULL;
+    service->stopped = RT_NULL;
+    service->workspace = RT_NULL;
+}
+
+/* Starts the thread of "service" (at "priority", with "stackSize" bytes of
+   stack) for requests up to "maxVersion", with a workspace of that version
+ */
+rt_int8_t qrcode_startService(QRService *service, rt_uint8_t maxVersion,
+    rt_uint8_t priority, rt_uint32_t stackSize) {
+    rt_memset(service, 0, sizeof(*service));
+    if ((maxVersion < 1) || (maxVersion > 40)) return -RT_EINVAL;
+    service->maxVersion = maxVersion;
+
+    service->workspace = (rt_uint8_t *)rt_malloc(
+        qrcode_getWorkspaceSize(maxVersion));
+    service->queue = rt_mq_create(SV_NAME, sizeof(QRRequest *),
+        QR_SERVICE_QUEUE, RT_IPC_FLAG_FIFO);
+    service->stopped = rt_sem_create(SV_NAME, 0, RT_IPC_FLAG_FIFO);
+    if (service->workspace && service->queue && service->stopped) {
+        service->thread = rt_thread_create(SV_NAME, sv_run, service,
+            stackSize, priority, 10);
+    }
+    if (!service->thread) {
+        sv_free(service);
+        LOG_W("No Memory");
+        return -RT_ENOMEM;
+    }
+    rt_thread_startup(service->thread);
+    return RT_EOK;
+}
+
+/* Queues "request" without waiting. It completes, with its "result", once
+   encoded, or superseded by a later request of the same slot.
+ */
+rt_int8_t qrcode_submit(QRService *service, QRRequest *request) {
+    rt_uint8_t version;
+
+    version = request->version ? request->version : \
+        request->options.maxVersion;
+    if ((request->slot >= QR_SERVICE_SLOTS) || !request->modules || \
+        !request->data || (version > service->maxVersion)) {
+        return -RT_EINVAL;
+    }
+    if (-RT_EBUSY == request->result) return -RT_EBUSY;
+
+    request->result = -RT_EBUSY;
+    if (rt_mq_send(service->queue, &request, sizeof(request)) != RT_EOK) {
+        request->result = -RT_EFULL;
+        return -RT_EFULL;
+    }
+    return RT_EOK;
+}
+
+/* Stops the thread after the current encode, and cancels the other requests.
+   Nothing may be submitted from then on.
+ */
+rt_int8_t qrcode_stopService(QRService *service) {
+    QRRequest *stop = RT_NULL;
+
+    if (!service->thread) return -RT_EINVAL;
+    while (rt_mq_urgent(service->queue, &stop, sizeof(stop)) != RT_EOK) {
+        rt_thread_mdelay(1);
+    }
+    rt_sem_take(service->stopped, RT_WAITING_FOREVER);
+    service->thread = RT_NULL;
+    sv_free(service);
+    return RT_EOK;
+}
+#endif /* QR_SERVICE */
@@ -50,6 +50,7 @@
 #define MODE_NUMERIC                0
 #define MODE_ALPHANUMERIC           1
 #define MODE_BYTE                   2
+#define MODE_MIXED                  3   // QRCode.mode of segmented data
 
 // Error Correction Code Levels
 #define ECC_LOW                     0
@@ -57,12 +58,104 @@
 #define ECC_QUARTILE                2
 #define ECC_HIGH                    3
 
-// If set to non-zero, this library can ONLY produce QR codes at that version
-// This saves a lot of dynamic memory, as the codeword tables are skipped
+// If set to non-zero (1 to 40), this library can ONLY produce QR codes at that
+// version. This saves a lot of flash, as the codeword tables are replaced by
+// the constants of that version (see "qrcode_lock.h")
 #ifndef LOCK_VERSION
 #define LOCK_VERSION                0
 #endif
 
+// If set to non-zero, Reed-Solomon arithmetic uses 511 bytes of log/antilog
+// tables (in flash) instead of a bitwise multiplication loop
+#ifndef QR_GF_TABLES
+#define QR_GF_TABLES                1
+#endif
+
+// If set to non-zero, the function patterns of this many versions are kept in
+// heap (one block of two grids per version) and copied into new symbols
+// instead of being drawn again
+#ifndef QR_TEMPLATE_CACHE
+#define QR_TEMPLATE_CACHE           0
+#endif
+
+// If set to non-zero, cached templates also map where the data bits go (up to
+// 1.6 KB per version), so the codewords are placed without the zigzag scan.
+// The map is only kept in templates: it requires QR_TEMPLATE_CACHE, and is on
+// by default with it
+#ifndef QR_PLACEMENT_MAP
+# if QR_TEMPLATE_CACHE
+#  define QR_PLACEMENT_MAP          1
+# else
+#  define QR_PLACEMENT_MAP          0
+# endif
+#endif
+#if QR_PLACEMENT_MAP && !QR_TEMPLATE_CACHE
+# error "QR_PLACEMENT_MAP requires QR_TEMPLATE_CACHE"
+#endif
+
+// If set to non-zero, function modules are worked out from the version instead
+// of being marked in a grid, which saves a grid of scratch (up to 3.9 KB) but
+// makes the encode slower
+#ifndef QR_LOW_MEMORY
+#define QR_LOW_MEMORY               0
+#endif
+
+// If set to non-zero, qrcode_writeFd() passes the exported files to write() of
+// DFS (with RT_USING_DFS) or of POSIX
+#ifndef QR_EXPORT_FD
+# ifdef RT_USING_DFS
+#  define QR_EXPORT_FD              1
+# else
+#  define QR_EXPORT_FD              0
+# endif
+#endif
+
+// If set to non-zero, qrcode_startService() runs the encodes in a thread of
+// their own, fed through a message queue (see QRService)
+#ifndef QR_SERVICE
+#define QR_SERVICE                  0
+#endif
+
+// Display slots of the service: a request replaces the one pending for its slot
+#ifndef QR_SERVICE_SLOTS
+#define QR_SERVICE_SLOTS            4
+#endif
+
+// Requests the message queue of the service holds until its thread takes them
+#ifndef QR_SERVICE_QUEUE
+#define QR_SERVICE_QUEUE            8
+#endif
+
+// Pass as the version to pick the smallest one in QRCodeOptions' range
+#define QR_VERSION_AUTO             0
+
+// Mask Choice (QRCodeOptions.mask), besides a fixed mask from 0 to 7
+#define QR_MASK_AUTO                (-1)    // Lowest penalty score
+#define QR_MASK_FAST                (-2)    // Best sampled estimate, no full scoring
+
+// Upper bound of qrcode_getWorkspaceSize(), for static buffers
+#if QR_LOW_MEMORY
+#define QRCODE_WORKSPACE_SIZE(version) \
+    (4 * (((4 * (version) + 17) * (4 * (version) + 17) + 7) / 8) / 3)
+#else
+#define QRCODE_WORKSPACE_SIZE(version) \
+    (2 * (((4 * (version) + 17) * (4 * (version) + 17) + 7) / 8))
+#endif
+
+typedef struct QRCodeOptions {
+    rt_int8_t mask;
+    // If not RT_NULL, at least qrcode_getWorkspaceSizeEx() bytes of scratch
+    // used instead of the heap
+    rt_uint8_t *workspace;
+    // Version range of QR_VERSION_AUTO; "modules" and "workspace" must fit
+    // "maxVersion"
+    rt_uint8_t minVersion;
+    rt_uint8_t maxVersion;
+    // If RT_TRUE, the data is split into numeric, alphanumeric and byte
+    // segments taking the fewest bits
+    rt_bool_t mixedMode;
+} QRCodeOptions;
+
 typedef struct QRCode {
     rt_uint8_t version;
     rt_uint8_t size;
@@ -72,15 +165,158 @@ typedef struct QRCode {
     rt_uint8_t *modules;
 } QRCode;
 
+// Column pairs of the codeword placement of the largest symbol
+#if LOCK_VERSION
+#define QR_COLUMN_PAIRS             (2 * LOCK_VERSION + 8)
+#else
+#define QR_COLUMN_PAIRS             88
+#endif
+
+/* A symbol kept with its codewords, so that the characters of its data can be
+   patched in place (see qrcode_patchSymbol())
+ */
+typedef struct QRSymbol {
+    QRCode qrcode;
+    // qrcode_getWorkspaceSize() bytes holding the codewords (and the function
+    // modules), kept from qrcode_initSymbol() on
+    rt_uint8_t *workspace;
+    rt_uint16_t length;
+    rt_uint16_t pairBits[QR_COLUMN_PAIRS];  // First data bit of each column pair
+} QRSymbol;
+
+// Formats of qrcode_serialize(), after a header of QR_WIRE_HEADER_SIZE bytes
+#define QR_WIRE_PACKED              0   // The modules grid
+#define QR_WIRE_CODEWORDS           1   // The codewords, no function patterns
+#define QR_WIRE_DATA                2   // The segments only, no padding nor ECC
+#define QR_WIRE_HEADER_SIZE         2
+
+// Output formats of qrcode_renderRow(), dark pixels are 1 (1bpp) or black
+#define QR_RENDER_1BPP_MSB          0   // 8 pixels per byte, leftmost in bit 7
+#define QR_RENDER_1BPP_LSB          1   // 8 pixels per byte, leftmost in bit 0
+#define QR_RENDER_PAGE              2   // 8 rows per byte (SSD1306), top in bit 0
+#define QR_RENDER_GRAY8             3   // 1 byte per pixel
+#define QR_RENDER_RGB565            4   // 2 bytes per pixel
+
+typedef struct QRRenderOptions {
+    rt_uint8_t format;
+    rt_uint8_t scale;       // Pixels per module
+    rt_uint8_t quietZone;   // Light modules on each side, 4 by the standard
+    rt_bool_t invert;       // If RT_TRUE, dark and light are swapped
+} QRRenderOptions;
+
+// A region of a rendered symbol, in pixels (see qrcode_getDirtyRects())
+typedef struct QRRect {
+    rt_uint16_t x;
+    rt_uint16_t y;
+    rt_uint16_t width;
+    rt_uint16_t height;
+} QRRect;
+
+// Character sets of qrcode_renderTermLine()
+#define QR_TERM_UTF8                0   // U+2580, U+2584 and U+2588 blocks
+#define QR_TERM_CP437               1   // 0xDF, 0xDC and 0xDB blocks
+
+typedef struct QRTermOptions {
+    rt_uint8_t charset;
+    rt_uint8_t quietZone;   // Light modules on each side
+    // If RT_TRUE, light modules are drawn as blocks (for a dark background)
+    rt_bool_t invert;
+} QRTermOptions;
+
+// File formats of qrcode_export()
+#define QR_EXPORT_PBM               0   // Binary PBM (P4)
+#define QR_EXPORT_SVG               1   // One path of the runs of dark modules
+#define QR_EXPORT_PNG               2   // 1-bit grayscale, stored deflate blocks
+
+/* Called with each part of an exported file, returns the number of bytes
+   written (fewer to be called again with the rest) or a negative error
+ */
+typedef rt_int32_t (*QRWriter)(void *context, const void *data,
+    rt_size_t length);
+
+#if QR_SERVICE
+typedef struct QRRequest QRRequest;
+
+/* An encode for the service, owned by the caller but read by the service
+   from qrcode_submit() until it completes
+ */
+struct QRRequest {
+    rt_uint8_t slot;            // Display slot, below QR_SERVICE_SLOTS
+    rt_uint8_t priority;        // Lower first, then in order of submission
+    rt_uint8_t version;         // Or QR_VERSION_AUTO
+    rt_uint8_t ecc;
+    const rt_uint8_t *data;
+    rt_uint16_t length;
+    QRCodeOptions options;      // But the workspace: the service has its own
+    rt_uint8_t *modules;        // qrcode_getBufferSize() of the (max) version
+    // On completion, in this order and if set: called (in the service thread),
+    // released and sent
+    void (*done)(QRRequest *request);
+    void *context;
+    rt_sem_t sem;
+    rt_event_t event;
+    rt_uint32_t set;
+    // Set by the service
+    QRCode qrcode;
+    // -RT_EBUSY until completed, then the result of the encode, or -RT_EINTR
+    // if superseded or cancelled
+    volatile rt_int8_t result;
+    rt_uint32_t sequence;
+};
+
+typedef struct QRService {
+    rt_thread_t thread;
+    rt_mq_t queue;              // Of QRRequest pointers, RT_NULL to stop
+    rt_sem_t stopped;
+    rt_uint8_t *workspace;      // Of maxVersion
+    rt_uint8_t maxVersion;
+    QRRequest *pending[QR_SERVICE_SLOTS];
+    rt_uint32_t sequence;
+    // Requests encoded and superseded
+    rt_uint32_t encoded;
+    rt_uint32_t superseded;
+} QRService;
+#endif /* QR_SERVICE */
+
 
 #ifdef __cplusplus
 extern "C"{
 #endif  /* __cplusplus */
 
 rt_uint16_t qrcode_getBufferSize(rt_uint8_t version);
+rt_uint16_t qrcode_getWorkspaceSize(rt_uint8_t version);
+rt_uint16_t qrcode_getWorkspaceSizeEx(rt_uint8_t version, const QRCodeOptions *options);
+rt_uint16_t qrcode_getCapacity(rt_uint8_t version, rt_uint8_t ecc, rt_uint8_t mode);
 rt_int8_t qrcode_initText(QRCode *qrcode, rt_uint8_t *modules, rt_uint8_t version, rt_uint8_t ecc, const char *data);
 rt_int8_t qrcode_initBytes(QRCode *qrcode, rt_uint8_t *modules, rt_uint8_t version, rt_uint8_t ecc, rt_uint8_t *data, rt_uint16_t length);
+void qrcode_initOptions(QRCodeOptions *options);
+rt_int8_t qrcode_initBytesEx(QRCode *qrcode, rt_uint8_t *modules, rt_uint8_t version, rt_uint8_t ecc, rt_uint8_t *data, rt_uint16_t length, const QRCodeOptions *options);
 rt_bool_t qrcode_getModule(QRCode *qrcode, rt_uint8_t x, rt_uint8_t y);
+rt_int8_t qrcode_initSymbol(QRSymbol *symbol, rt_uint8_t *modules, rt_uint8_t *workspace, rt_uint8_t version, rt_uint8_t ecc, rt_uint8_t *data, rt_uint16_t length, const QRCodeOptions *options);
+rt_int8_t qrcode_patchSymbol(QRSymbol *symbol, rt_uint16_t offset, const rt_uint8_t *data, rt_uint16_t length, rt_bool_t keepMask);
+rt_uint16_t qrcode_getSerializedSize(rt_uint8_t version, rt_uint8_t ecc, rt_uint8_t format);
+rt_int32_t qrcode_serialize(QRCode *qrcode, rt_uint8_t format, rt_uint8_t *workspace, rt_uint8_t *buffer, rt_uint16_t size);
+rt_int8_t qrcode_deserialize(QRCode *qrcode, rt_uint8_t *modules, rt_uint8_t *workspace, const rt_uint8_t *buffer, rt_uint16_t length);
+void qrcode_initRenderOptions(QRRenderOptions *options);
+rt_uint16_t qrcode_getRenderSize(QRCode *qrcode, const QRRenderOptions *options);
+rt_uint32_t qrcode_getRowBytes(QRCode *qrcode, const QRRenderOptions *options);
+rt_int8_t qrcode_renderRow(QRCode *qrcode, const QRRenderOptions *options, rt_uint16_t y, rt_uint8_t *line);
+rt_int32_t qrcode_getDirtyRects(QRCode *before, QRCode *after, const QRRenderOptions *options, QRRect *rects, rt_uint16_t maxRects);
+void qrcode_initTermOptions(QRTermOptions *options);
+rt_uint16_t qrcode_getTermLines(QRCode *qrcode, const QRTermOptions *options);
+rt_uint16_t qrcode_getTermLineSize(QRCode *qrcode, const QRTermOptions *options);
+rt_int16_t qrcode_renderTermLine(QRCode *qrcode, const QRTermOptions *options, rt_uint16_t line, char *buffer);
+rt_uint32_t qrcode_getExportBufferSize(QRCode *qrcode, rt_uint8_t format, const QRRenderOptions *options);
+rt_int32_t qrcode_export(QRCode *qrcode, rt_uint8_t format, const QRRenderOptions *options, QRWriter write, void *context, rt_uint8_t *buffer);
+#if QR_EXPORT_FD
+rt_int32_t qrcode_writeFd(void *context, const void *data, rt_size_t length);
+#endif
+#if QR_SERVICE
+void qrcode_initRequest(QRRequest *request);
+rt_int8_t qrcode_startService(QRService *service, rt_uint8_t maxVersion, rt_uint8_t priority, rt_uint32_t stackSize);
+rt_int8_t qrcode_submit(QRService *service, QRRequest *request);
+rt_int8_t qrcode_stopService(QRService *service);
+#endif
 
 #ifdef __cplusplus
 }
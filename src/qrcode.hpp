@@ -0,0 +1,164 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2017 Richard Moore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ *  C++ (C++11) front-end: a symbol of a version and ECC level fixed at compile
+ *  time, holding its modules and its workspace, so it lives on the stack or in
+ *  ".bss" and encodes without any heap.
+ *
+ *      static QRCodeT<3, ECC_LOW> qr;
+ *
+ *      qr.encodeLiteral("HELLO WORLD");   // Too long for v3-L: compile error
+ *      if (qr.getModule(x, y)) ...
+ *
+ *  With a single version in the program, also build the library with
+ *  LOCK_VERSION set to it to get its tables and loop bounds folded.
+ */
+
+
+#ifndef __QRCODE_HPP__
+#define __QRCODE_HPP__
+
+#include "qrcode.h"
+#include "qrcode_tables.h"
+
+namespace qrcode_detail {
+
+// The tables of the encoder, by ECC level (ECC_LOW to ECC_HIGH)
+constexpr rt_uint16_t ECC_CODEWORDS[4][40] = {
+    QR_ECC_CODEWORDS_LOW,
+    QR_ECC_CODEWORDS_MEDIUM,
+    QR_ECC_CODEWORDS_QUARTILE,
+    QR_ECC_CODEWORDS_HIGH,
+};
+
+constexpr rt_uint16_t RAW_DATA_MODULES[40] = QR_RAW_DATA_MODULES;
+
+constexpr rt_uint8_t getModeBits(rt_uint8_t version, rt_uint8_t mode) {
+    return (MODE_NUMERIC == mode) ? \
+            ((version <= 9) ? 10 : (version <= 26) ? 12 : 14) : \
+        (MODE_ALPHANUMERIC == mode) ? \
+            ((version <= 9) ? 9 : (version <= 26) ? 11 : 13) : \
+        ((version <= 9) ? 8 : 16);
+}
+
+// Characters of "mode" in the payload bits of a single segment
+constexpr rt_uint16_t getCharacters(rt_uint32_t bits, rt_uint8_t mode) {
+    return (MODE_NUMERIC == mode) ? bits / 10 * 3 + \
+            ((bits % 10 >= 7) ? 2 : (bits % 10 >= 4) ? 1 : 0) : \
+        (MODE_ALPHANUMERIC == mode) ? bits / 11 * 2 + \
+            ((bits % 11 >= 6) ? 1 : 0) : \
+        bits / 8;
+}
+
+// As qrcode_getCapacity()
+constexpr rt_uint16_t getCapacity(rt_uint8_t version, rt_uint8_t ecc,
+    rt_uint8_t mode) {
+    return getCharacters((RAW_DATA_MODULES[version - 1] / 8 - \
+        ECC_CODEWORDS[ecc][version - 1]) * 8 - 4 - getModeBits(version, mode),
+        mode);
+}
+
+}  /* namespace qrcode_detail */
+
+template <rt_uint8_t Version, rt_uint8_t Ecc = ECC_LOW>
+class QRCodeT {
+    static_assert((Version >= 1) && (Version <= 40),
+        "QR Code versions are 1 to 40");
+    static_assert(Ecc <= ECC_HIGH, "Unknown ECC level");
+    static_assert((LOCK_VERSION == 0) || (LOCK_VERSION == Version),
+        "The library is locked to another version");
+
+public:
+    static constexpr rt_uint8_t SIZE = 4 * Version + 17;
+    static constexpr rt_uint16_t BUFFER_SIZE = (SIZE * SIZE + 7) / 8;
+    static constexpr rt_uint16_t WORKSPACE_SIZE = QRCODE_WORKSPACE_SIZE(Version);
+
+    // Characters of "mode" (MODE_NUMERIC to MODE_BYTE) the symbol holds
+    static constexpr rt_uint16_t capacity(rt_uint8_t mode) {
+        return qrcode_detail::getCapacity(Version, Ecc, mode);
+    }
+
+    QRCodeT() : qrcode_() {
+        qrcode_initOptions(&options_);
+    }
+
+    // Options of the next encodes, but the version and the workspace
+    QRCodeOptions &options() {
+        return options_;
+    }
+
+    rt_int8_t encode(const rt_uint8_t *data, rt_uint16_t length) {
+        options_.workspace = workspace_;
+        return qrcode_initBytesEx(&qrcode_, modules_, Version, Ecc,
+            const_cast<rt_uint8_t *>(data), length, &options_);
+    }
+
+    rt_int8_t encodeText(const char *text) {
+        return encode(reinterpret_cast<const rt_uint8_t *>(text),
+            rt_strlen(text));
+    }
+
+    /* The literal is checked at compile time against the byte mode capacity,
+       which any text fits in
+     */
+    template <rt_size_t N>
+    rt_int8_t encodeLiteral(const char (&literal)[N]) {
+        static_assert(N - 1 <= capacity(MODE_BYTE),
+            "Literal too long for this version and ECC level");
+        return encode(reinterpret_cast<const rt_uint8_t *>(literal), N - 1);
+    }
+
+    rt_bool_t getModule(rt_uint8_t x, rt_uint8_t y) const {
+        rt_uint32_t offset;
+
+        if ((x >= SIZE) || (y >= SIZE)) return RT_FALSE;
+        offset = y * SIZE + x;
+        return (modules_[offset >> 3] >> (7 - (offset & 0x07))) & 1;
+    }
+
+    // The C view, valid after a successful encode
+    const QRCode &qrcode() const {
+        return qrcode_;
+    }
+
+    const rt_uint8_t *modules() const {
+        return modules_;
+    }
+
+private:
+    QRCode qrcode_;
+    QRCodeOptions options_;
+    rt_uint8_t modules_[BUFFER_SIZE];
+    rt_uint8_t workspace_[WORKSPACE_SIZE];
+};
+
+template <rt_uint8_t Version, rt_uint8_t Ecc>
+constexpr rt_uint8_t QRCodeT<Version, Ecc>::SIZE;
+template <rt_uint8_t Version, rt_uint8_t Ecc>
+constexpr rt_uint16_t QRCodeT<Version, Ecc>::BUFFER_SIZE;
+template <rt_uint8_t Version, rt_uint8_t Ecc>
+constexpr rt_uint16_t QRCodeT<Version, Ecc>::WORKSPACE_SIZE;
+
+#endif  /* __QRCODE_HPP__ */
@@ -0,0 +1,43 @@
+/* Per-version tables shared by "qrcode.c" and the C++ front-end
+   ("qrcode.hpp"), as initializer lists of the versions 1 to 40, so that the
+   capacities worked out at compile time are those of the encoder.
+ */
+
+#ifndef __QRCODE_TABLES_H__
+#define __QRCODE_TABLES_H__
+
+// ECC codewords of the whole symbol, by ECC level
+#define QR_ECC_CODEWORDS_LOW        { \
+       7,   10,   15,   20,   26,   36,   40,   48,   60,   72, \
+      80,   96,  104,  120,  132,  144,  168,  180,  196,  224, \
+     224,  252,  270,  300,  312,  336,  360,  390,  420,  450, \
+     480,  510,  540,  570,  570,  600,  630,  660,  720,  750 \
+}
+#define QR_ECC_CODEWORDS_MEDIUM     { \
+      10,   16,   26,   36,   48,   64,   72,   88,  110,  130, \
+     150,  176,  198,  216,  240,  280,  308,  338,  364,  416, \
+     442,  476,  504,  560,  588,  644,  700,  728,  784,  812, \
+     868,  924,  980, 1036, 1064, 1120, 1204, 1260, 1316, 1372 \
+}
+#define QR_ECC_CODEWORDS_QUARTILE   { \
+      13,   22,   36,   52,   72,   96,  108,  132,  160,  192, \
+     224,  260,  288,  320,  360,  408,  448,  504,  546,  600, \
+     644,  690,  750,  810,  870,  952, 1020, 1050, 1140, 1200, \
+    1290, 1350, 1440, 1530, 1590, 1680, 1770, 1860, 1950, 2040 \
+}
+#define QR_ECC_CODEWORDS_HIGH       { \
+      17,   28,   44,   64,   88,  112,  130,  156,  192,  224, \
+     264,  308,  352,  384,  432,  480,  532,  588,  650,  700, \
+     750,  816,  900,  960, 1050, 1110, 1200, 1260, 1350, 1440, \
+    1530, 1620, 1710, 1800, 1890, 1980, 2100, 2220, 2310, 2430 \
+}
+
+// Modules left for the codewords once the function patterns are drawn
+#define QR_RAW_DATA_MODULES         { \
+      208,   359,   567,   807,  1079,  1383,  1568,  1936,  2336,  2768, \
+     3232,  3728,  4256,  4651,  5243,  5867,  6523,  7211,  7931,  8683, \
+     9252, 10068, 10916, 11796, 12708, 13652, 14628, 15371, 16411, 17483, \
+    18587, 19723, 20891, 22091, 23008, 24272, 25568, 26896, 28256, 29648 \
+}
+
+#endif /* __QRCODE_TABLES_H__ */